@@ -0,0 +1,344 @@
+#ifndef ASSETARCHIVE_H
+#define ASSETARCHIVE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Layout of an asset archive, the cooked models of a whole directory (written by src/cooker.cpp).
+// All offsets are from the start of the file, tables are stored as the structs lie in memory:
+//     AssetArchiveHeader
+//     AssetArchiveEntry[entryCount]     table of contents, sorted by path
+//     MeshCacheMesh[meshCount]          the meshes of all entries, entry by entry
+//     MeshCacheLod[lodCount]
+//     MeshCacheMaterial[materialCount]  every distinct material once, shared by the entries using it
+//     string table                      every distinct string once
+//     vertex and index blobs, each aligned to MESH_CACHE_ALIGNMENT
+// Unlike a mesh cache the archive does not check the sources, it is a build product shipped instead of them.
+const uint32_t ASSET_ARCHIVE_MAGIC = 0x4B504E4E; // "NNPK"
+const uint32_t ASSET_ARCHIVE_VERSION = 2;
+
+struct AssetArchiveHeader {
+    uint32_t magic, version;
+    uint32_t entryCount, meshCount, lodCount, materialCount;
+    // the load options every entry was cooked with, see meshCacheFlags
+    GLfloat weldEpsilon;
+    uint32_t flags;
+    uint64_t stringOffset, stringSize;
+};
+
+// one model, looked up by the path Model is constructed with
+struct AssetArchiveEntry {
+    MeshCacheString path;
+    uint32_t firstMesh, meshCount;
+};
+
+// Writes the archive of the given models (path as Model will ask for it, and its mesh cache), returns false
+// (and leaves no file) on failure. Every cache has to be built with options.
+inline bool writeAssetArchive(const string& archivePath, vector<pair<string, const MeshCache*>> models, const ObjLoadOptions& options)
+{
+    sort(models.begin(), models.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    string strings;
+    map<string, MeshCacheString> stringIds;
+    auto addString = [&](string_view text) {
+        auto it = stringIds.find(string(text));
+        if (it != stringIds.end())
+            return it->second;
+        MeshCacheString s{(uint32_t)strings.size(), (uint32_t)text.size()};
+        strings += text;
+        stringIds.emplace(string(text), s);
+        return s;
+    };
+    auto align = [](uint64_t offset) {
+        return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+    };
+
+    // a material is shared when its name and values match
+    vector<MeshCacheMaterial> materialTable;
+    map<string, uint32_t> materialIds;
+    auto addMaterial = [&](string_view name, const Material& material) {
+        MeshCacheMaterial m = encodeMaterial(material, addString(name));
+        string key = string(name) + '\0' + string((const char*)m.ambient, sizeof(GLfloat) * 10);
+        auto it = materialIds.find(key);
+        if (it != materialIds.end())
+            return it->second;
+        materialIds.emplace(key, (uint32_t)materialTable.size());
+        materialTable.push_back(m);
+        return (uint32_t)materialTable.size() - 1;
+    };
+
+    vector<AssetArchiveEntry> entries;
+    vector<MeshCacheMesh> meshTable;
+    vector<MeshCacheLod> lodTable;
+    // where the blobs of each mesh table entry come from
+    vector<pair<const MeshCache*, size_t>> meshSources;
+    for (const auto& [path, cache]: models) {
+        if (cache->layout() != meshCacheLayout(meshCacheFlags(options)))
+            return false;
+        entries.push_back(AssetArchiveEntry{addString(path), (uint32_t)meshTable.size(), (uint32_t)cache->meshCount()});
+        for (size_t i = 0; i < cache->meshCount(); ++i) {
+            MeshCacheMesh m = cache->mesh(i);
+            m.material = addMaterial(cache->materialName(m.material), cache->material(m.material));
+            m.firstLod = (uint32_t)lodTable.size();
+            for (const MeshLod& lod: cache->lods(i))
+                lodTable.push_back(MeshCacheLod{lod.firstIndex, lod.indexCount, lod.error, 0});
+            meshTable.push_back(m);
+            meshSources.push_back(make_pair(cache, i));
+        }
+    }
+
+    AssetArchiveHeader header = {};
+    header.magic = ASSET_ARCHIVE_MAGIC;
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    header.meshCount = (uint32_t)meshTable.size();
+    header.lodCount = (uint32_t)lodTable.size();
+    header.materialCount = (uint32_t)materialTable.size();
+    header.weldEpsilon = options.weldEpsilon;
+    header.flags = meshCacheFlags(options);
+    header.stringOffset = sizeof(AssetArchiveHeader) + entries.size() * sizeof(AssetArchiveEntry) + meshTable.size() * sizeof(MeshCacheMesh)
+        + lodTable.size() * sizeof(MeshCacheLod) + materialTable.size() * sizeof(MeshCacheMaterial);
+    header.stringSize = strings.size();
+
+    VertexLayout layout = meshCacheLayout(header.flags);
+    uint64_t offset = align(header.stringOffset + header.stringSize);
+    for (MeshCacheMesh& m: meshTable) {
+        m.vertexOffset = offset;
+        offset = align(offset + (uint64_t)m.vertexCount * vertexFormat(layout).stride);
+        m.indexOffset = offset;
+        offset = align(offset + (uint64_t)m.indexCount * indexSize(indexType(layout, m.vertexCount)));
+    }
+
+    string tempPath = archivePath + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        uint64_t written = 0;
+        auto write = [&](const void* data, size_t size) {
+            out.write((const char*)data, size);
+            written += size;
+        };
+        auto pad = [&]() {
+            static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+            write(zeros, align(written) - written);
+        };
+
+        write(&header, sizeof(header));
+        write(entries.data(), entries.size() * sizeof(AssetArchiveEntry));
+        write(meshTable.data(), meshTable.size() * sizeof(MeshCacheMesh));
+        write(lodTable.data(), lodTable.size() * sizeof(MeshCacheLod));
+        write(materialTable.data(), materialTable.size() * sizeof(MeshCacheMaterial));
+        write(strings.data(), strings.size());
+        for (size_t i = 0; i < meshTable.size(); ++i) {
+            const MeshCacheMesh& m = meshTable[i];
+            const MeshCache& cache = *meshSources[i].first;
+            pad();
+            write(cache.vertices(meshSources[i].second), (size_t)m.vertexCount * vertexFormat(layout).stride);
+            pad();
+            write(cache.indices(meshSources[i].second), (size_t)m.indexCount * indexSize(indexType(layout, m.vertexCount)));
+        }
+        pad();
+
+        if (!out.good()) {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    error_code error;
+    filesystem::rename(tempPath, archivePath, error);
+    if (error) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// A memory-mapped asset archive. Meshes are addressed by their index in the archive mesh table,
+// an entry owns the meshes [firstMesh, firstMesh + meshCount). The pointers stay valid while the object lives.
+class AssetArchive
+{
+public:
+    // maps the archive once and checks it is intact
+    bool open(const string& path)
+    {
+        if (!file.open(path) || !validate()) {
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // whether the archive was cooked with the load options that change the meshes
+    bool matches(const ObjLoadOptions& options) const
+    {
+        return header()->weldEpsilon == options.weldEpsilon && header()->flags == meshCacheFlags(options);
+    }
+
+    // the entry of the model loaded from path, nullptr when the archive does not hold it
+    const AssetArchiveEntry* find(string_view path) const
+    {
+        const AssetArchiveEntry* begin = entries();
+        const AssetArchiveEntry* end = begin + header()->entryCount;
+        const AssetArchiveEntry* it = lower_bound(begin, end, path, [this](const AssetArchiveEntry& entry, string_view path) {
+            return text(entry.path) < path;
+        });
+        return it != end && text(it->path) == path ? it : nullptr;
+    }
+
+    size_t entryCount() const
+    {
+        return header()->entryCount;
+    }
+
+    string_view entryPath(size_t i) const
+    {
+        return text(entries()[i].path);
+    }
+
+    const MeshCacheMesh& mesh(size_t i) const
+    {
+        return meshes()[i];
+    }
+
+    VertexLayout layout() const
+    {
+        return meshCacheLayout(header()->flags);
+    }
+
+    // the vertex blob of mesh i, Vertex or PackedVertex depending on layout()
+    const void* vertices(size_t i) const
+    {
+        return file.data() + mesh(i).vertexOffset;
+    }
+
+    // the index blob of mesh i, of type indexType(layout(), vertex count)
+    const void* indices(size_t i) const
+    {
+        return file.data() + mesh(i).indexOffset;
+    }
+
+    vector<MeshLod> lods(size_t i) const
+    {
+        return decodeLods(mesh(i), lodTable());
+    }
+
+    string_view materialName(size_t i) const
+    {
+        return text(materials()[i].name);
+    }
+
+    Material material(size_t i) const
+    {
+        return decodeMaterial(materials()[i]);
+    }
+
+private:
+    MappedFile file;
+
+    const AssetArchiveHeader* header() const
+    {
+        return (const AssetArchiveHeader*)file.data();
+    }
+
+    const AssetArchiveEntry* entries() const
+    {
+        return (const AssetArchiveEntry*)(file.data() + sizeof(AssetArchiveHeader));
+    }
+
+    const MeshCacheMesh* meshes() const
+    {
+        return (const MeshCacheMesh*)(entries() + header()->entryCount);
+    }
+
+    const MeshCacheLod* lodTable() const
+    {
+        return (const MeshCacheLod*)(meshes() + header()->meshCount);
+    }
+
+    const MeshCacheMaterial* materials() const
+    {
+        return (const MeshCacheMaterial*)(lodTable() + header()->lodCount);
+    }
+
+    string_view text(MeshCacheString s) const
+    {
+        return string_view(file.data() + header()->stringOffset + s.offset, s.length);
+    }
+
+    bool inFile(uint64_t offset, uint64_t size) const
+    {
+        return offset <= file.size() && size <= file.size() - offset;
+    }
+
+    bool validate() const
+    {
+        if (!inFile(0, sizeof(AssetArchiveHeader)))
+            return false;
+        const AssetArchiveHeader& h = *header();
+        if (h.magic != ASSET_ARCHIVE_MAGIC || h.version != ASSET_ARCHIVE_VERSION)
+            return false;
+
+        uint64_t tables = (uint64_t)h.entryCount * sizeof(AssetArchiveEntry) + (uint64_t)h.meshCount * sizeof(MeshCacheMesh)
+            + (uint64_t)h.lodCount * sizeof(MeshCacheLod) + (uint64_t)h.materialCount * sizeof(MeshCacheMaterial);
+        if (h.stringOffset != sizeof(AssetArchiveHeader) + tables || !inFile(h.stringOffset, h.stringSize))
+            return false;
+
+        auto validString = [&](MeshCacheString s) {
+            return (uint64_t)s.offset + s.length <= h.stringSize;
+        };
+
+        for (uint32_t i = 0; i < h.entryCount; ++i) {
+            const AssetArchiveEntry& entry = entries()[i];
+            if (!validString(entry.path) || (uint64_t)entry.firstMesh + entry.meshCount > h.meshCount)
+                return false;
+            // find() depends on the order
+            if (i > 0 && !(text(entries()[i - 1].path) < text(entry.path)))
+                return false;
+        }
+
+        for (uint32_t i = 0; i < h.materialCount; ++i)
+            if (!validString(materials()[i].name))
+                return false;
+
+        for (uint32_t i = 0; i < h.meshCount; ++i) {
+            const MeshCacheMesh& m = meshes()[i];
+            if (m.lodCount == 0 || (uint64_t)m.firstLod + m.lodCount > h.lodCount)
+                return false;
+            for (uint32_t l = 0; l < m.lodCount; ++l) {
+                const MeshCacheLod& lod = lodTable()[m.firstLod + l];
+                if ((uint64_t)lod.firstIndex + lod.indexCount > m.indexCount)
+                    return false;
+            }
+            if (m.material >= h.materialCount || m.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || m.indexOffset % MESH_CACHE_ALIGNMENT != 0)
+                return false;
+            VertexLayout layout = meshCacheLayout(h.flags);
+            uint64_t vertexBytes = (uint64_t)m.vertexCount * vertexFormat(layout).stride;
+            uint64_t indexBytes = (uint64_t)m.indexCount * indexSize(indexType(layout, m.vertexCount));
+            if (!inFile(m.vertexOffset, vertexBytes) || !inFile(m.indexOffset, indexBytes))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef ASSETREGISTRY_H
+#define ASSETREGISTRY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "AssetArchive.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include "ObjLoaderParallel.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class AssetRegistry;
+AssetRegistry& assetRegistry();
+
+// parses an OBJ file and runs the mesh passes options ask for, i.e. everything a mesh cache saves
+inline bool buildModelData(const string& path, ModelData& data, const ObjLoadOptions& options)
+{
+    PROFILE_ZONE("build model");
+    bool loaded = options.threads == 1 ? loadObj(path, data, options) : loadObjParallel(path, data, options);
+    for (MeshData& mesh: data.meshes) {
+        if (options.optimizeMeshes)
+            optimizeMesh(mesh.vertices, mesh.indices);
+        if (options.lodLevels > 0)
+            mesh.lods = buildLodChain(mesh.vertices, mesh.indices, min<GLuint>(options.lodLevels, 15));
+        if (options.optimizeMeshes)
+            for (MeshLodData& lod: mesh.lods)
+                optimizeVertexCache(lod.indices, mesh.vertices.size());
+    }
+    return loaded;
+}
+
+// The meshes (with their GL buffers) and materials loaded from one OBJ file.
+// Every Model built from the same file shares one ModelAsset.
+// Loading has a CPU stage (parse), which may run on any thread, and a GPU stage (uploadNext) for the GL thread;
+// the asset is resident, i.e. drawable, once every mesh is uploaded.
+class ModelAsset
+{
+public:
+    vector<Mesh> meshes;
+    map<string, Material> materials;
+    string path;
+
+    ModelAsset(string path)
+    {
+        this->path = std::move(path);
+    }
+
+    ModelAsset(const ModelAsset&) = delete;
+    ModelAsset& operator =(const ModelAsset&) = delete;
+
+    // the GL buffers are handed to the registry, which deletes them on the GL thread
+    ~ModelAsset();
+
+    // loads an OBJ model (with its MTL library) and stores the resulting meshes in the meshes vector.
+    void load(const ObjLoadOptions& options, shared_ptr<const AssetArchive> archive = nullptr)
+    {
+        PROFILE_ZONE("load model");
+        parse(options, std::move(archive));
+        while (!uploadNext());
+    }
+
+    // parses the OBJ file, or maps its mesh cache, without touching GL.
+    // A mounted archive cooked with the same options is used instead when it holds the model.
+    void parse(const ObjLoadOptions& options, shared_ptr<const AssetArchive> archive = nullptr)
+    {
+        PROFILE_ZONE("parse model");
+        layout = options.compressVertices ? VERTEX_PACKED : VERTEX_FLOAT;
+        occluder = options.occluder;
+        // a Model without a file (e.g. a default constructed Player) has no meshes to read
+        if (path.empty())
+            return;
+        if (archive && archive->matches(options) && (entry = archive->find(path))) {
+            this->archive = std::move(archive);
+            for (size_t i = entry->firstMesh; i < entry->firstMesh + entry->meshCount; ++i) {
+                size_t material = this->archive->mesh(i).material;
+                this->materials[string(this->archive->materialName(material))] = this->archive->material(material);
+            }
+            return;
+        }
+
+        string cachePath = meshCachePath(path, options);
+        if (options.meshCache) {
+            cache.reset(new MeshCache());
+            if (cache->open(cachePath, path, options)) {
+                for (size_t i = 0; i < cache->materialCount(); ++i)
+                    this->materials[string(cache->materialName(i))] = cache->material(i);
+                return;
+            }
+            cache.reset();
+        }
+
+        if (!buildModelData(path, data, options))
+            cout << "ERROR::MODEL::FILE_NOT_SUCCESFULLY_READ: " << path << endl;
+        else if (options.meshCache && !writeMeshCache(cachePath, path, data, options))
+            cout << "ERROR::MODEL::CACHE_NOT_SUCCESFULLY_WRITTEN: " << cachePath << endl;
+
+        this->materials = std::move(data.materials);
+    }
+
+    // creates the GL buffers of the next parsed mesh, returns true once the asset is resident
+    bool uploadNext()
+    {
+        PROFILE_ZONE("upload mesh");
+        size_t count = archive ? entry->meshCount : cache ? cache->meshCount() : data.meshes.size();
+        if (meshes.size() < count) {
+            size_t i = meshes.size();
+            if (archive) {
+                size_t index = entry->firstMesh + i;
+                const MeshCacheMesh& mesh = archive->mesh(index);
+                glm::vec3 boundsMin(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+                glm::vec3 boundsMax(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+                Material material = archive->material(mesh.material);
+                this->meshes.push_back(Mesh(archive->vertices(index), mesh.vertexCount, archive->indices(index), mesh.indexCount, archive->layout(), material, boundsMin, boundsMax, archive->lods(index)));
+                if (occluder)
+                    this->meshes.back().decodeCopy(archive->vertices(index), mesh.vertexCount, archive->indices(index));
+            }
+            else if (cache) {
+                const MeshCacheMesh& mesh = cache->mesh(i);
+                glm::vec3 boundsMin(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+                glm::vec3 boundsMax(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+                Material material = this->materials[string(cache->materialName(mesh.material))];
+                this->meshes.push_back(Mesh(cache->vertices(i), mesh.vertexCount, cache->indices(i), mesh.indexCount, cache->layout(), material, boundsMin, boundsMax, cache->lods(i)));
+                if (occluder)
+                    this->meshes.back().decodeCopy(cache->vertices(i), mesh.vertexCount, cache->indices(i));
+            }
+            else {
+                MeshData& mesh = data.meshes[i];
+                this->meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), this->materials[mesh.material], layout, mesh.lods));
+            }
+        }
+
+        if (meshes.size() < count)
+            return false;
+
+        // the parsed data is in the GL buffers now
+        archive.reset();
+        cache.reset();
+        data = ModelData();
+        resident = true;
+        return true;
+    }
+
+    bool isResident() const
+    {
+        return resident;
+    }
+
+private:
+    // parsed meshes waiting for their upload
+    ModelData data;
+    unique_ptr<MeshCache> cache;
+    // or the archive entry holding the meshes
+    shared_ptr<const AssetArchive> archive;
+    const AssetArchiveEntry* entry = nullptr;
+    VertexLayout layout = VERTEX_FLOAT;
+    // the meshes keep a CPU copy for DrawOccluder
+    bool occluder = false;
+    atomic<bool> resident{false};
+};
+
+// Hands out one shared ModelAsset per (path, options that change the meshes). The registry only keeps weak references,
+// an asset is freed when the last Model using it goes away.
+class AssetRegistry
+{
+public:
+    // returns the loaded asset for path, loading it on first use (on the GL thread)
+    shared_ptr<ModelAsset> load(const string& path, const ObjLoadOptions& options = ObjLoadOptions())
+    {
+        lock_guard<recursive_mutex> lock(mutex);
+        shared_ptr<ModelAsset> asset = find(path, options);
+        if (asset)
+            return asset;
+
+        asset = add(path, options);
+        asset->load(options, archive);
+        return asset;
+    }
+
+    // returns the asset for path at once; a new one is parsed on a worker thread and uploaded by processUploads,
+    // it stays non resident until then
+    shared_ptr<ModelAsset> loadAsync(const string& path, const ObjLoadOptions& options = ObjLoadOptions())
+    {
+        lock_guard<recursive_mutex> lock(mutex);
+        shared_ptr<ModelAsset> asset = find(path, options);
+        if (asset)
+            return asset;
+
+        asset = add(path, options);
+        workers.submit([this, asset, options, archive = this->archive]() {
+            asset->parse(options, archive);
+            lock_guard<recursive_mutex> lock(mutex);
+            uploads.push_back(asset);
+        });
+        return asset;
+    }
+
+    // uploads parsed meshes until budget milliseconds have passed (at least one mesh), call on the GL thread
+    void processUploads(GLfloat budget)
+    {
+        PROFILE_ZONE("process uploads");
+        auto start = chrono::steady_clock::now();
+        for (;;) {
+            shared_ptr<ModelAsset> asset;
+            {
+                lock_guard<recursive_mutex> lock(mutex);
+                if (uploads.empty())
+                    return;
+                asset = uploads.front();
+            }
+
+            if (asset->uploadNext()) {
+                lock_guard<recursive_mutex> lock(mutex);
+                uploads.pop_front();
+            }
+
+            chrono::duration<GLfloat, milli> elapsed = chrono::steady_clock::now() - start;
+            if (elapsed.count() >= budget)
+                return;
+        }
+    }
+
+    // serves the models in the archive at path (see src/cooker.cpp) from it instead of their files,
+    // for the loads that ask for the options it was cooked with. Returns false when it cannot be opened.
+    bool mountArchive(const string& path)
+    {
+        PROFILE_ZONE("mount archive");
+        shared_ptr<AssetArchive> archive = make_shared<AssetArchive>();
+        if (!archive->open(path))
+            return false;
+        lock_guard<recursive_mutex> lock(mutex);
+        this->archive = archive;
+        return true;
+    }
+
+    // queues meshes that are no longer used, their GL objects are deleted by collectGarbage
+    void retire(vector<Mesh>&& meshes)
+    {
+        lock_guard<recursive_mutex> lock(mutex);
+        retired.insert(retired.end(), make_move_iterator(meshes.begin()), make_move_iterator(meshes.end()));
+        meshes.clear();
+    }
+
+    // deletes the retired GL objects and forgets expired assets, call on the GL thread (e.g. once per frame)
+    void collectGarbage()
+    {
+        PROFILE_ZONE("collect garbage");
+        lock_guard<recursive_mutex> lock(mutex);
+        for (Mesh& mesh: retired)
+            mesh.release();
+        retired.clear();
+
+        for (auto it = assets.begin(); it != assets.end();)
+            it = it->second.expired() ? assets.erase(it) : next(it);
+    }
+
+    // how many load() calls were served by an already loaded asset / had to load the file
+    size_t getHits()
+    {
+        return this->hits;
+    }
+
+    size_t getLoads()
+    {
+        return this->loads;
+    }
+
+    // parsed assets waiting for processUploads
+    size_t getPendingUploads()
+    {
+        lock_guard<recursive_mutex> lock(mutex);
+        return this->uploads.size();
+    }
+
+private:
+    // an asset freed while another one loads retires its meshes from the same thread.
+    // Declared first so it outlives the members below, whose destruction may free assets.
+    recursive_mutex mutex;
+    vector<Mesh> retired;
+    map<tuple<string, GLfloat, uint32_t, bool>, weak_ptr<ModelAsset>> assets;
+    size_t hits = 0, loads = 0;
+    // parsed assets waiting for processUploads
+    deque<shared_ptr<ModelAsset>> uploads;
+    shared_ptr<const AssetArchive> archive;
+    ThreadPool workers;
+
+    static tuple<string, GLfloat, uint32_t, bool> key(const string& path, const ObjLoadOptions& options)
+    {
+        return make_tuple(path, options.weldEpsilon, meshCacheFlags(options), options.occluder);
+    }
+
+    shared_ptr<ModelAsset> find(const string& path, const ObjLoadOptions& options)
+    {
+        auto it = assets.find(key(path, options));
+        shared_ptr<ModelAsset> asset = it == assets.end() ? nullptr : it->second.lock();
+        if (asset)
+            ++hits;
+        return asset;
+    }
+
+    shared_ptr<ModelAsset> add(const string& path, const ObjLoadOptions& options)
+    {
+        shared_ptr<ModelAsset> asset = make_shared<ModelAsset>(path);
+        assets[key(path, options)] = asset;
+        ++loads;
+        return asset;
+    }
+};
+
+inline AssetRegistry& assetRegistry()
+{
+    static AssetRegistry registry;
+    return registry;
+}
+
+inline ModelAsset::~ModelAsset()
+{
+    assetRegistry().retire(std::move(meshes));
+}
+
+#endif
@@ -27,6 +27,29 @@ const GLfloat SENSITIVTY = 0.25f;
 const GLfloat ZOOM = 45.0f;
 
 
+// The six planes of a view volume as (normal, distance), normals pointing inside and normalized, so
+// dot(normal, point) + distance is the signed distance of a point. Order: left, right, bottom, top, near, far.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // extracts the planes from a projection * view matrix (Gribb & Hartmann), they come out in world space
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        Frustum frustum;
+        for (int i = 0; i < 3; ++i) {
+            frustum.planes[2 * i] = rows[3] + rows[i];
+            frustum.planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& plane: frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+};
+
 // An abstract camera class that processes input and calculates the corresponding Eular Angles, Vectors and Matrices for use in OpenGL
 class Camera
 {
@@ -70,6 +93,12 @@ public:
         return glm::lookAt(this->Position, this->Position + this->Front, this->Up);
     }
 
+    // Returns the world space view volume of the camera seen through projection
+    Frustum GetFrustum(const glm::mat4& projection)
+    {
+        return Frustum::fromMatrix(projection * this->GetViewMatrix());
+    }
+
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime)
     {
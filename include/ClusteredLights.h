@@ -0,0 +1,353 @@
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTEREDLIGHTS_SSE
+#endif
+
+using namespace std;
+
+// a point light as CalcPointLight in shader.frag sees it
+struct PointLight {
+    glm::vec3 position;
+    GLfloat constant;
+    GLfloat linear;
+    GLfloat quadratic;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// the distance at which the brightest channel of a light has faded to 1/256, lights are cut off there
+inline GLfloat pointLightRadius(const PointLight& light, GLfloat farPlane)
+{
+    GLfloat brightest = max(max(max(light.diffuse.x, light.diffuse.y), light.diffuse.z), max(max(light.specular.x, light.specular.y), light.specular.z));
+    // brightest / (constant + linear d + quadratic d^2) = 1 / 256
+    GLfloat c = light.constant - 256.0f * brightest;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (light.quadratic > 0.0f)
+        return min((-light.linear + sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic), farPlane);
+    if (light.linear > 0.0f)
+        return min(-c / light.linear, farPlane);
+    return farPlane;
+}
+
+// what the last build did
+struct ClusteredLightStats {
+    size_t lights = 0;
+    // lights inside the view, the ones binned
+    size_t visibleLights = 0;
+    // light references in all clusters, and the ones dropped because a cluster was full
+    size_t references = 0, dropped = 0;
+    size_t maxPerCluster = 0;
+};
+
+// Clustered forward lighting: the view volume is cut into a grid of froxels, TILES_X x TILES_Y screen tiles times
+// SLICES depth slices spaced exponentially from the near plane, and every frame each cluster gets the list of point
+// lights whose sphere touches its view space box. The fragment shader finds its cluster from gl_FragCoord and its
+// view depth and only evaluates those lights, so its cost follows the lights near it, not the lights in the scene.
+// build bins on the CPU (depth slices on several threads, 4 clusters per SSE sphere-box test), upload sends the
+// light data, the (first, count) per cluster and the compact index list to buffer textures.
+class ClusteredLights
+{
+public:
+    static const GLuint TILES_X = 16, TILES_Y = 9, SLICES = 24;
+    static const GLuint CLUSTERS = TILES_X * TILES_Y * SLICES;
+    // keeps the per-fragment loop bounded however the lights crowd together
+    static const GLuint MAX_LIGHTS_PER_CLUSTER = 128;
+
+    ClusteredLights(unsigned threads = 0)
+    {
+        this->threads = threads;
+        clusterLights.resize(CLUSTERS);
+    }
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator =(const ClusteredLights&) = delete;
+
+    // the projection the clusters follow, fovY in radians; the cluster boxes are only rebuilt when it changes
+    void setProjection(GLfloat fovY, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane, GLuint viewportWidth, GLuint viewportHeight)
+    {
+        this->viewportWidth = viewportWidth;
+        this->viewportHeight = viewportHeight;
+        if (fovY == this->fovY && aspect == this->aspect && nearPlane == this->nearPlane && farPlane == this->farPlane)
+            return;
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        buildClusterBoxes();
+    }
+
+    // bins lights (world space) into the clusters of the camera with the given view matrix,
+    // lights has to stay alive until upload
+    void build(const vector<PointLight>& lights, const glm::mat4& view)
+    {
+        stats = ClusteredLightStats();
+        stats.lights = lights.size();
+        this->lights = &lights;
+
+        // view space spheres of the lights that reach into the view depth range at all
+        spheres.clear();
+        for (size_t i = 0; i < lights.size(); ++i) {
+            GLfloat radius = pointLightRadius(lights[i], farPlane);
+            glm::vec3 centre = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            if (radius <= 0.0f || -centre.z + radius < nearPlane || -centre.z - radius > farPlane)
+                continue;
+            spheres.push_back(Sphere{centre, radius, (uint32_t)i});
+        }
+        stats.visibleLights = spheres.size();
+
+        // each slice only writes its own clusters
+        frameWorkers().parallelFor(SLICES, threads, [&](size_t slice) {
+            binSlice((GLuint)slice);
+        });
+
+        // compact: (first, count) per cluster into one index list
+        grid.resize(2 * CLUSTERS);
+        indices.clear();
+        for (GLuint c = 0; c < CLUSTERS; ++c) {
+            vector<uint32_t>& list = clusterLights[c];
+            if (list.size() > MAX_LIGHTS_PER_CLUSTER) {
+                stats.dropped += list.size() - MAX_LIGHTS_PER_CLUSTER;
+                list.resize(MAX_LIGHTS_PER_CLUSTER);
+            }
+            grid[2 * c] = (uint32_t)indices.size();
+            grid[2 * c + 1] = (uint32_t)list.size();
+            indices.insert(indices.end(), list.begin(), list.end());
+            stats.maxPerCluster = max(stats.maxPerCluster, list.size());
+        }
+        stats.references = indices.size();
+    }
+
+    // sends the result of build to the GPU
+    void upload()
+    {
+        if (dataBuffer == 0)
+            create();
+
+        // 4 texels per light, see shader.frag
+        lightData.resize(4 * lights->size());
+        for (size_t i = 0; i < lights->size(); ++i) {
+            const PointLight& light = (*lights)[i];
+            lightData[4 * i] = glm::vec4(light.position, light.constant);
+            lightData[4 * i + 1] = glm::vec4(light.ambient, light.linear);
+            lightData[4 * i + 2] = glm::vec4(light.diffuse, light.quadratic);
+            lightData[4 * i + 3] = glm::vec4(light.specular, 0.0f);
+        }
+        // never empty, a buffer texture over no storage is incomplete
+        if (lightData.empty())
+            lightData.push_back(glm::vec4(0.0f));
+        const uint32_t none = 0;
+
+        glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, lightData.size() * sizeof(glm::vec4), lightData.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(uint32_t), grid.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, max<size_t>(indices.size(), 1) * sizeof(uint32_t), indices.empty() ? &none : indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // binds the buffer textures and sets the cluster uniforms of shader, which has to be in use
+    void apply(Shader& shader)
+    {
+        if (dataBuffer == 0)
+            create();
+        glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+        glActiveTexture(GL_TEXTURE0 + LIGHT_GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glActiveTexture(GL_TEXTURE0 + LIGHT_INDICES_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        // slice = log(depth) * scale + bias, so depth near lands on 0 and far on SLICES
+        GLfloat sliceScale = SLICES / log(farPlane / nearPlane);
+        shader.setVec3("clusterCounts", glm::vec3(TILES_X, TILES_Y, SLICES));
+        shader.setVec3("clusterScale", glm::vec3((GLfloat)TILES_X / viewportWidth, (GLfloat)TILES_Y / viewportHeight, sliceScale));
+        shader.setFloat("clusterBias", -log(nearPlane) * sliceScale);
+    }
+
+    // the cluster of a view space point, as the fragment shader computes it (for tests), -1 outside the grid
+    GLint clusterOf(glm::vec3 viewPosition) const
+    {
+        if (-viewPosition.z < nearPlane || -viewPosition.z >= farPlane)
+            return -1;
+        GLfloat tanY = tan(fovY * 0.5f), tanX = tanY * aspect;
+        GLfloat depth = -viewPosition.z;
+        GLint x = (GLint)floor((viewPosition.x / (depth * tanX) * 0.5f + 0.5f) * TILES_X);
+        GLint y = (GLint)floor((viewPosition.y / (depth * tanY) * 0.5f + 0.5f) * TILES_Y);
+        GLint z = (GLint)floor(log(depth / nearPlane) / log(farPlane / nearPlane) * SLICES);
+        if (x < 0 || x >= (GLint)TILES_X || y < 0 || y >= (GLint)TILES_Y || z < 0 || z >= (GLint)SLICES)
+            return -1;
+        return x + TILES_X * (y + TILES_Y * z);
+    }
+
+    // (first index, count) per cluster and the index list of the last build
+    const vector<uint32_t>& getGrid() const
+    {
+        return this->grid;
+    }
+
+    const vector<uint32_t>& getIndices() const
+    {
+        return this->indices;
+    }
+
+    const ClusteredLightStats& getStats() const
+    {
+        return this->stats;
+    }
+
+    // deletes the GL objects, call on the GL thread while the context is alive
+    void release()
+    {
+        if (dataBuffer == 0)
+            return;
+        GLuint buffers[] = {dataBuffer, gridBuffer, indexBuffer};
+        GLuint textures[] = {dataTexture, gridTexture, indexTexture};
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(3, textures);
+        dataBuffer = gridBuffer = indexBuffer = 0;
+        dataTexture = gridTexture = indexTexture = 0;
+    }
+
+private:
+    struct Sphere {
+        glm::vec3 centre;
+        GLfloat radius;
+        uint32_t light;
+    };
+
+    unsigned threads;
+    GLfloat fovY = 0.0f, aspect = 0.0f, nearPlane = 0.0f, farPlane = 0.0f;
+    GLuint viewportWidth = 1, viewportHeight = 1;
+    // view space box of every cluster as structure of arrays, for the SSE test
+    vector<GLfloat> boxMinX, boxMinY, boxMinZ, boxMaxX, boxMaxY, boxMaxZ;
+    // depth range [near, far) of every slice
+    vector<GLfloat> sliceNear, sliceFar;
+
+    const vector<PointLight>* lights = nullptr;
+    vector<Sphere> spheres;
+    vector<vector<uint32_t>> clusterLights;
+    vector<uint32_t> grid, indices;
+    vector<glm::vec4> lightData;
+    ClusteredLightStats stats;
+
+    GLuint dataBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+    GLuint dataTexture = 0, gridTexture = 0, indexTexture = 0;
+
+    void create()
+    {
+        glGenBuffers(1, &dataBuffer);
+        glGenBuffers(1, &gridBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenTextures(1, &dataTexture);
+        glGenTextures(1, &gridTexture);
+        glGenTextures(1, &indexTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // the view space box around the part of the view volume of each cluster
+    void buildClusterBoxes()
+    {
+        for (vector<GLfloat>* lane: {&boxMinX, &boxMinY, &boxMinZ, &boxMaxX, &boxMaxY, &boxMaxZ})
+            lane->resize(CLUSTERS);
+        sliceNear.resize(SLICES);
+        sliceFar.resize(SLICES);
+
+        GLfloat tanY = tan(fovY * 0.5f), tanX = tanY * aspect;
+        for (GLuint z = 0; z < SLICES; ++z) {
+            GLfloat depth0 = nearPlane * pow(farPlane / nearPlane, (GLfloat)z / SLICES);
+            GLfloat depth1 = nearPlane * pow(farPlane / nearPlane, (GLfloat)(z + 1) / SLICES);
+            sliceNear[z] = depth0;
+            sliceFar[z] = depth1;
+            for (GLuint y = 0; y < TILES_Y; ++y)
+                for (GLuint x = 0; x < TILES_X; ++x) {
+                    // the tile edges in normalized device coordinates, then at both depths of the slice
+                    GLfloat ndcX0 = 2.0f * x / TILES_X - 1.0f, ndcX1 = 2.0f * (x + 1) / TILES_X - 1.0f;
+                    GLfloat ndcY0 = 2.0f * y / TILES_Y - 1.0f, ndcY1 = 2.0f * (y + 1) / TILES_Y - 1.0f;
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    for (GLfloat depth: {depth0, depth1})
+                        for (GLfloat ndcX: {ndcX0, ndcX1})
+                            for (GLfloat ndcY: {ndcY0, ndcY1}) {
+                                glm::vec3 corner(ndcX * depth * tanX, ndcY * depth * tanY, -depth);
+                                low = glm::min(low, corner);
+                                high = glm::max(high, corner);
+                            }
+                    GLuint c = x + TILES_X * (y + TILES_Y * z);
+                    boxMinX[c] = low.x;
+                    boxMinY[c] = low.y;
+                    boxMinZ[c] = low.z;
+                    boxMaxX[c] = high.x;
+                    boxMaxY[c] = high.y;
+                    boxMaxZ[c] = high.z;
+                }
+        }
+    }
+
+    // fills the light lists of the clusters of one depth slice
+    void binSlice(GLuint slice)
+    {
+        GLuint first = slice * TILES_X * TILES_Y;
+        GLuint last = first + TILES_X * TILES_Y;
+        for (GLuint c = first; c < last; ++c)
+            clusterLights[c].clear();
+
+        for (const Sphere& sphere: spheres) {
+            GLfloat depth = -sphere.centre.z;
+            if (depth + sphere.radius < sliceNear[slice] || depth - sphere.radius > sliceFar[slice])
+                continue;
+            GLuint c = first;
+#if defined(CLUSTEREDLIGHTS_SSE)
+            // squared distance from the centre to each box, clamping the centre into the box per axis
+            __m128 cx = _mm_set1_ps(sphere.centre.x), cy = _mm_set1_ps(sphere.centre.y), cz = _mm_set1_ps(sphere.centre.z);
+            __m128 radius2 = _mm_set1_ps(sphere.radius * sphere.radius);
+            for (; c + 4 <= last; c += 4) {
+                __m128 dx = _mm_sub_ps(cx, _mm_max_ps(_mm_loadu_ps(&boxMinX[c]), _mm_min_ps(cx, _mm_loadu_ps(&boxMaxX[c]))));
+                __m128 dy = _mm_sub_ps(cy, _mm_max_ps(_mm_loadu_ps(&boxMinY[c]), _mm_min_ps(cy, _mm_loadu_ps(&boxMaxY[c]))));
+                __m128 dz = _mm_sub_ps(cz, _mm_max_ps(_mm_loadu_ps(&boxMinZ[c]), _mm_min_ps(cz, _mm_loadu_ps(&boxMaxZ[c]))));
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+                for (GLuint k = 0; k < 4; ++k)
+                    if (mask & (1u << k))
+                        clusterLights[c + k].push_back(sphere.light);
+            }
+#endif
+            for (; c < last; ++c)
+                if (touches(sphere, c))
+                    clusterLights[c].push_back(sphere.light);
+        }
+    }
+
+    bool touches(const Sphere& sphere, GLuint c) const
+    {
+        GLfloat dx = sphere.centre.x - max(boxMinX[c], min(sphere.centre.x, boxMaxX[c]));
+        GLfloat dy = sphere.centre.y - max(boxMinY[c], min(sphere.centre.y, boxMaxY[c]));
+        GLfloat dz = sphere.centre.z - max(boxMinZ[c], min(sphere.centre.z, boxMaxZ[c]));
+        return (dx * dx + dy * dy) + dz * dz <= sphere.radius * sphere.radius;
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef FRAMEPACKET_H
+#define FRAMEPACKET_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "AssetRegistry.h"
+#include "ClusteredLights.h"
+#include "FrameUniforms.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// one mesh to draw, with the level of detail and the transforms it had when the frame was simulated
+struct FramePacketDraw {
+    Mesh* mesh;
+    GLuint lod;
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    // the program of a RenderQueue draw, nullptr for a copy drawn by the InstanceRenderer
+    Shader* shader;
+};
+
+// a mesh drawn into the software occlusion culler
+struct FramePacketOccluder {
+    const Mesh* mesh;
+    glm::mat4 model;
+};
+
+// Everything the render thread needs to draw a frame, written by the simulation thread and only read after it is
+// handed over, so the two threads never share mutable state. The assets of the meshes are held by the packet:
+// a model freed by the simulation keeps its meshes until the render thread is done with the packets using them.
+struct FramePacket {
+    uint64_t frame = 0;
+    GLfloat time = 0.0f;
+    // camera and directional light, as they go into the FrameData block
+    FrameUniforms uniforms;
+    glm::vec3 cameraPosition;
+    // the perspective of uniforms.projection, fovY in radians
+    GLfloat fovY = 0.0f, aspect = 1.0f, nearPlane = 0.1f, farPlane = 100.0f;
+    // framebuffer size in pixels
+    GLint width = 0, height = 0;
+    vector<FramePacketDraw> draws;
+    // corners of the occluder boxes, 8 per box in CollisionRectangle order, and occluder meshes
+    vector<glm::vec3> occluderBoxes;
+    vector<FramePacketOccluder> occluderMeshes;
+    vector<PointLight> lights;
+    vector<shared_ptr<ModelAsset>> assets;
+
+    // empties the packet for the next frame, keeping the memory
+    void clear()
+    {
+        draws.clear();
+        occluderBoxes.clear();
+        occluderMeshes.clear();
+        lights.clear();
+        assets.clear();
+    }
+};
+
+// Triple buffer between one producer (the simulation) and one consumer (the render thread), the packets change
+// hands through one atomic. The producer fills writable and publishes it, the consumer acquires the newest published
+// packet; neither waits for the other, and a packet published before the last one was taken is replaced by it.
+// A side that has nothing to do sleeps in waitAcquire / waitTaken instead of polling, close wakes both for good.
+class FramePacketExchange
+{
+public:
+    FramePacketExchange() = default;
+    FramePacketExchange(const FramePacketExchange&) = delete;
+    FramePacketExchange& operator =(const FramePacketExchange&) = delete;
+
+    // the packet the producer fills, no other thread touches it until publish
+    FramePacket& writable()
+    {
+        return packets[writeSlot];
+    }
+
+    // hands writable over, the producer gets a free packet to fill next
+    void publish()
+    {
+        writeSlot = ready.exchange(writeSlot | FRESH, memory_order_acq_rel) & SLOT;
+        wake(published);
+    }
+
+    // the newest published packet when one came since the last acquire, nullptr otherwise.
+    // The packet stays the consumer's until the next successful acquire
+    FramePacket* acquire()
+    {
+        if (!(ready.load(memory_order_acquire) & FRESH))
+            return nullptr;
+        readSlot = ready.exchange(readSlot, memory_order_acq_rel) & SLOT;
+        wake(taken);
+        return &packets[readSlot];
+    }
+
+    // the same as acquire, but sleeps until a packet is published; nullptr once closed and the last packet is taken
+    FramePacket* waitAcquire()
+    {
+        {
+            unique_lock<mutex> lock(sleepLock);
+            published.wait(lock, [&]() { return pending() || closed; });
+        }
+        return acquire();
+    }
+
+    // whether a published packet is still waiting for the consumer
+    bool pending() const
+    {
+        return (ready.load(memory_order_acquire) & FRESH) != 0;
+    }
+
+    // sleeps until the consumer took the published packet, or the exchange is closed
+    void waitTaken()
+    {
+        unique_lock<mutex> lock(sleepLock);
+        taken.wait(lock, [&]() { return !pending() || closed; });
+    }
+
+    // wakes both sides for good: waitAcquire returns nullptr (after the last packet), waitTaken returns at once
+    void close()
+    {
+        {
+            lock_guard<mutex> lock(sleepLock);
+            closed = true;
+        }
+        published.notify_all();
+        taken.notify_all();
+    }
+
+private:
+    static const unsigned SLOT = 3, FRESH = 4;
+
+    // the change a sleeper tests for is in ready already, taking the lock orders it before the sleeper's test
+    void wake(condition_variable& condition)
+    {
+        { lock_guard<mutex> lock(sleepLock); }
+        condition.notify_one();
+    }
+
+    FramePacket packets[3];
+    // only used by the producer / consumer, the third slot index is in ready
+    unsigned writeSlot = 0, readSlot = 1;
+    atomic<unsigned> ready{2};
+
+    mutex sleepLock;
+    condition_variable published, taken;
+    bool closed = false;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef FRAMERENDERER_H
+#define FRAMERENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "ClusteredLights.h"
+#include "FramePacket.h"
+#include "FrameUniforms.h"
+#include "IndirectDraw.h"
+#include "InstanceRenderer.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// The GL side of a frame: draws a FramePacket with shader through the engine's passes (frame uniforms and instances
+// streamed through the upload ring, software occlusion, clustered lights, the sorted render queue and the instance
+// renderer). It owns the GL objects of those passes, so it is created and used on the thread owning the context;
+// with the null graphics backend (see GraphicsDevice.h) it runs without one.
+class FrameRenderer
+{
+public:
+    // load is what the backend was loaded with, for the extensions it finds
+    FrameRenderer(Shader& shader, GLADloadproc load)
+        : shader(shader), uploads(1 << 20, 3, loadBufferStorage(load))
+    {
+        frameUniforms.setUploadRing(&uploads);
+        instances.setUploadRing(&uploads);
+        // a single draw call per program and vertex layout where the driver has multi-draw indirect
+        renderQueue.setIndirect(loadMultiDrawIndirect(load));
+    }
+
+    FrameRenderer(const FrameRenderer&) = delete;
+    FrameRenderer& operator =(const FrameRenderer&) = delete;
+
+    // draws packet into the bound framebuffer, the caller swaps
+    void render(const FramePacket& packet)
+    {
+        PROFILE_ZONE("render");
+        gpuProfiler.beginFrame();
+        PROFILE_GPU_ZONE(gpuProfiler, "frame");
+        if (packet.width != viewportWidth || packet.height != viewportHeight) {
+            viewportWidth = packet.width;
+            viewportHeight = packet.height;
+            glViewport(0, 0, viewportWidth, viewportHeight);
+        }
+        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // don't forget to enable shader before setting uniforms
+        shader.use();
+
+        // camera and light, written once for every program
+        uploads.begin();
+        frameUniforms.update(packet.uniforms);
+        // whatever is outside the view is dropped by the queues before drawing
+        glm::mat4 viewProjection = packet.uniforms.projection * packet.uniforms.view;
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        renderQueue.setFrustum(frustum);
+        instances.setFrustum(frustum);
+        drawOccluders(packet, viewProjection);
+        renderQueue.setOcclusion(&occlusion);
+        instances.setOcclusion(&occlusion);
+        buildLights(packet);
+
+        renderQueue.begin(packet.cameraPosition, packet.farPlane);
+        for (const FramePacketDraw& draw: packet.draws) {
+            if (draw.shader != nullptr)
+                renderQueue.add(*draw.shader, *draw.mesh, draw.lod, draw.model, draw.normalMatrix);
+            else
+                instances.add(*draw.mesh, draw.lod, InstanceData{draw.model, draw.normalMatrix});
+        }
+        {
+            PROFILE_GPU_ZONE(gpuProfiler, "render queue");
+            renderQueue.flush();
+        }
+        {
+            PROFILE_GPU_ZONE(gpuProfiler, "instances");
+            instances.flush(shader);
+        }
+        uploads.end();
+    }
+
+    RenderQueue& getRenderQueue()
+    {
+        return this->renderQueue;
+    }
+
+    InstanceRenderer& getInstances()
+    {
+        return this->instances;
+    }
+
+    OcclusionCuller& getOcclusion()
+    {
+        return this->occlusion;
+    }
+
+    ClusteredLights& getLights()
+    {
+        return this->lights;
+    }
+
+    UploadRing& getUploads()
+    {
+        return this->uploads;
+    }
+
+    GpuProfiler& getGpuProfiler()
+    {
+        return this->gpuProfiler;
+    }
+
+    // deletes the GL objects of the passes, call on the GL thread while the context is alive
+    void release()
+    {
+        frameUniforms.release();
+        instances.release();
+        renderQueue.release();
+        lights.release();
+        uploads.release();
+        gpuProfiler.release();
+    }
+
+private:
+    Shader& shader;
+    FrameUniformBuffer frameUniforms;
+    // per-frame data (the frame uniforms, the instances) is streamed through it, a region per frame in flight;
+    // persistently mapped where the driver has buffer storage
+    UploadRing uploads;
+    // static models are drawn through it, every copy of a mesh in one draw call
+    InstanceRenderer instances;
+    // the other models are collected here and drawn sorted by program, material and mesh
+    RenderQueue renderQueue;
+    // the floor and walls are drawn into it on the CPU, what they hide is not drawn at all
+    OcclusionCuller occlusion;
+    // the point lights of the packet, each fragment only shades the ones of its cluster
+    ClusteredLights lights;
+    // GPU times of the passes, on their own track of the profiler
+    GpuProfiler gpuProfiler;
+    GLint viewportWidth = 0, viewportHeight = 0;
+
+    // draws the occluders of packet into the depth buffer the queues test against
+    void drawOccluders(const FramePacket& packet, const glm::mat4& viewProjection)
+    {
+        PROFILE_ZONE("occlusion");
+        occlusion.begin(viewProjection);
+        for (size_t i = 0; i + 8 <= packet.occluderBoxes.size(); i += 8)
+            occlusion.addBox(vector<glm::vec3>(packet.occluderBoxes.begin() + i, packet.occluderBoxes.begin() + i + 8));
+        for (const FramePacketOccluder& occluder: packet.occluderMeshes)
+            occlusion.addTriangles(occluder.mesh->vertices.data(), occluder.mesh->vertices.size(), occluder.mesh->indices.data(), occluder.mesh->indices.size(), occluder.model);
+        occlusion.finish();
+    }
+
+    // assigns the lights of packet to the clusters of the view and hands them to shader
+    void buildLights(const FramePacket& packet)
+    {
+        PROFILE_ZONE("lights");
+        lights.setProjection(packet.fovY, packet.aspect, packet.nearPlane, packet.farPlane, (GLuint)max(viewportWidth, 1), (GLuint)max(viewportHeight, 1));
+        lights.build(packet.lights, packet.uniforms.view);
+        lights.upload();
+        lights.apply(shader);
+    }
+};
+
+#endif
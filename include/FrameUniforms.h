@@ -0,0 +1,89 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "UploadRing.h"
+
+#include <cstring>
+
+using namespace std;
+
+// CPU copy of the std140 uniform block FrameData declared in the shaders, members in the same order.
+// std140 pads vec3 to 16 bytes, so the vectors are vec4 with w unused.
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    // projection * view, multiplied once here instead of per vertex
+    glm::mat4 viewProjection;
+    glm::vec4 viewPos;
+    // the directional light
+    glm::vec4 lightDirection;
+    glm::vec4 lightAmbient;
+    glm::vec4 lightDiffuse;
+    glm::vec4 lightSpecular;
+};
+
+static_assert(sizeof(FrameUniforms) == 3 * 64 + 5 * 16, "FrameUniforms has to match the std140 layout of FrameData");
+
+// The uniform buffer behind FrameData, written once per frame and bound at FRAME_DATA_BINDING,
+// where every Shader finds it (see Shader::reflect). With an upload ring the frame's copy is a range of the ring
+// bound with glBindBufferRange instead.
+class FrameUniformBuffer
+{
+public:
+    FrameUniformBuffer()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+    }
+
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator =(const FrameUniformBuffer&) = delete;
+
+    // writes the frames through ring from now on (between its begin and end), nullptr goes back to the own buffer
+    void setUploadRing(UploadRing* ring)
+    {
+        this->ring = ring;
+    }
+
+    // replaces the contents for this frame, fills in viewProjection
+    void update(FrameUniforms frame)
+    {
+        frame.viewProjection = frame.projection * frame.view;
+        if (ring != nullptr) {
+            UploadRange range = ring->allocate(sizeof(FrameUniforms), ring->getUniformAlignment());
+            if (range.data != nullptr) {
+                memcpy(range.data, &frame, sizeof(FrameUniforms));
+                ring->flush();
+                glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ring->getBuffer(), range.offset, range.size);
+                return;
+            }
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        // orphaning the old storage lets the driver hand out fresh memory instead of waiting for last frame's draws
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // deletes the buffer, call on the GL thread while the context is alive
+    void release()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+
+private:
+    GLuint UBO;
+    UploadRing* ring = nullptr;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUMCULLER_SSE
+#endif
+
+using namespace std;
+
+// Tests many world space boxes against a frustum at once. The boxes are kept as structure of arrays (centres and
+// half extents per axis), so each plane is tested against 8 boxes per AVX instruction or 4 per SSE one; builds
+// without either (e.g. 32-bit MinGW without -msse) use the scalar loop, which gives the same answer.
+// Fill with add once per frame, cull returns the indices of the boxes that are at least partly inside.
+class FrustumCuller
+{
+public:
+    void clear()
+    {
+        for (vector<GLfloat>* lane: {&centreX, &centreY, &centreZ, &extentX, &extentY, &extentZ})
+            lane->clear();
+    }
+
+    // adds the object space box [boundsMin, boundsMax] moved by model, returns its index
+    uint32_t add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model)
+    {
+        // the world box around the transformed box (Arvo): the centre moves with model, the extents go through |model|
+        glm::vec3 centre = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+        glm::vec3 half = (boundsMax - boundsMin) * 0.5f;
+        glm::mat3 linear = glm::mat3(model);
+        glm::vec3 extent = glm::abs(linear[0]) * half.x + glm::abs(linear[1]) * half.y + glm::abs(linear[2]) * half.z;
+
+        centreX.push_back(centre.x);
+        centreY.push_back(centre.y);
+        centreZ.push_back(centre.z);
+        extentX.push_back(extent.x);
+        extentY.push_back(extent.y);
+        extentZ.push_back(extent.z);
+        return (uint32_t)(centreX.size() - 1);
+    }
+
+    size_t size() const
+    {
+        return centreX.size();
+    }
+
+    // the indices of the boxes added since clear that intersect frustum, in the order they were added
+    const vector<uint32_t>& cull(const Frustum& frustum)
+    {
+        visible.clear();
+        size_t count = size();
+        size_t i = 0;
+#if defined(__AVX__)
+        for (; i + 8 <= count; i += 8)
+            appendVisible(i, cullAvx(frustum, i));
+#elif defined(FRUSTUMCULLER_SSE)
+        for (; i + 4 <= count; i += 4)
+            appendVisible(i, cullSse(frustum, i));
+#endif
+        for (; i < count; ++i)
+            if (insideScalar(frustum, i))
+                visible.push_back((uint32_t)i);
+        return visible;
+    }
+
+    // the same test one box at a time, for checking the vector paths against
+    const vector<uint32_t>& cullScalar(const Frustum& frustum)
+    {
+        visible.clear();
+        for (size_t i = 0; i < size(); ++i)
+            if (insideScalar(frustum, i))
+                visible.push_back((uint32_t)i);
+        return visible;
+    }
+
+private:
+    vector<GLfloat> centreX, centreY, centreZ, extentX, extentY, extentZ;
+    vector<uint32_t> visible;
+
+    // a box is outside when it lies entirely behind one plane: the distance of its centre plus its
+    // projected radius |n.x| ex + |n.y| ey + |n.z| ez is negative
+    bool insideScalar(const Frustum& frustum, size_t i) const
+    {
+        for (const glm::vec4& plane: frustum.planes) {
+            // summed in the same order as the vector paths, so all of them agree on boxes touching a plane
+            GLfloat distance = (plane.x * centreX[i] + plane.y * centreY[i]) + (plane.z * centreZ[i] + plane.w);
+            GLfloat radius = (fabs(plane.x) * extentX[i] + fabs(plane.y) * extentY[i]) + fabs(plane.z) * extentZ[i];
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // bit k of mask set: box first + k is visible
+    void appendVisible(size_t first, unsigned mask)
+    {
+        for (; mask != 0; mask &= mask - 1) {
+            unsigned k = 0;
+            while (!(mask & (1u << k)))
+                ++k;
+            visible.push_back((uint32_t)(first + k));
+        }
+    }
+
+#if defined(__AVX__)
+    unsigned cullAvx(const Frustum& frustum, size_t first) const
+    {
+        __m256 cx = _mm256_loadu_ps(&centreX[first]), cy = _mm256_loadu_ps(&centreY[first]), cz = _mm256_loadu_ps(&centreZ[first]);
+        __m256 ex = _mm256_loadu_ps(&extentX[first]), ey = _mm256_loadu_ps(&extentY[first]), ez = _mm256_loadu_ps(&extentZ[first]);
+        __m256 outside = _mm256_setzero_ps();
+        for (const glm::vec4& plane: frustum.planes) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+                _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(fabs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(fabs(plane.y)))),
+                _mm256_mul_ps(ez, _mm256_set1_ps(fabs(plane.z))));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        return ~(unsigned)_mm256_movemask_ps(outside) & 0xFF;
+    }
+#elif defined(FRUSTUMCULLER_SSE)
+    unsigned cullSse(const Frustum& frustum, size_t first) const
+    {
+        __m128 cx = _mm_loadu_ps(&centreX[first]), cy = _mm_loadu_ps(&centreY[first]), cz = _mm_loadu_ps(&centreZ[first]);
+        __m128 ex = _mm_loadu_ps(&extentX[first]), ey = _mm_loadu_ps(&extentY[first]), ez = _mm_loadu_ps(&extentZ[first]);
+        __m128 outside = _mm_setzero_ps();
+        for (const glm::vec4& plane: frustum.planes) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(fabs(plane.y)))),
+                _mm_mul_ps(ez, _mm_set1_ps(fabs(plane.z))));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        return ~(unsigned)_mm_movemask_ps(outside) & 0xF;
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <glad/glad.h>
+
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// First-fit allocator of [offset, offset + size) ranges in a buffer of capacity elements.
+// Freed ranges are merged with free neighbours, so the free list only fragments where live ranges sit between.
+class RangeAllocator
+{
+public:
+    static const size_t NONE = (size_t)-1;
+
+    // everything free, the capacity can grow later (see grow)
+    void reset(size_t capacity)
+    {
+        this->capacity = capacity;
+        freeRanges.clear();
+        if (capacity > 0)
+            freeRanges[0] = capacity;
+    }
+
+    // the offset of a free range of size elements, NONE when no free range is large enough
+    size_t allocate(size_t size)
+    {
+        if (size == 0)
+            return 0;
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < size)
+                continue;
+            size_t offset = it->first;
+            size_t rest = it->second - size;
+            freeRanges.erase(it);
+            if (rest > 0)
+                freeRanges[offset + size] = rest;
+            return offset;
+        }
+        return NONE;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.begin()) {
+            auto previous = prev(next);
+            if (previous->first + previous->second == offset) {
+                offset = previous->first;
+                size += previous->second;
+                freeRanges.erase(previous);
+            }
+        }
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            freeRanges.erase(next);
+        }
+        freeRanges[offset] = size;
+    }
+
+    // adds the elements [capacity, newCapacity) as free space
+    void grow(size_t newCapacity)
+    {
+        size_t old = capacity;
+        capacity = newCapacity;
+        free(old, newCapacity - old);
+    }
+
+    size_t getCapacity() const
+    {
+        return this->capacity;
+    }
+
+    size_t freeSpace() const
+    {
+        size_t total = 0;
+        for (const auto& range: freeRanges)
+            total += range.second;
+        return total;
+    }
+
+    size_t largestFreeRange() const
+    {
+        size_t largest = 0;
+        for (const auto& range: freeRanges)
+            largest = max(largest, range.second);
+        return largest;
+    }
+
+    size_t freeRangeCount() const
+    {
+        return freeRanges.size();
+    }
+
+private:
+    size_t capacity = 0;
+    // offset -> size
+    map<size_t, size_t> freeRanges;
+};
+
+// One vertex buffer and one index buffer shared by every mesh of a vertex layout and index type, with a single VAO.
+// A mesh owns an allocation, a range of vertices and a range of indices; its indices stay relative to its
+// first vertex and are drawn with glDrawElementsBaseVertex. Full buffers grow, and a fragmented buffer is compacted
+// instead when the free space is there; both move allocations, so draws look their offsets up every time.
+class GeometryArena
+{
+public:
+    struct Allocation {
+        GLuint vertexOffset, vertexCount;
+        GLuint indexOffset, indexCount;
+        bool live;
+    };
+
+    // sizes in elements of the first buffers
+    static const size_t INITIAL_VERTICES = 1 << 16;
+    static const size_t INITIAL_INDICES = 1 << 18;
+
+    GeometryArena(VertexLayout layout, GLenum indexType)
+    {
+        this->layout = layout;
+        this->indexType = indexType;
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator =(const GeometryArena&) = delete;
+
+    // copies a mesh into the arena (creating the GL objects on first use), returns its allocation id
+    GLuint allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount)
+    {
+        if (VAO == 0)
+            create();
+
+        Allocation a;
+        a.vertexCount = (GLuint)vertexCount;
+        a.indexCount = (GLuint)indexCount;
+        a.vertexOffset = (GLuint)reserve(true, vertexCount);
+        a.indexOffset = (GLuint)reserve(false, indexCount);
+        a.live = true;
+
+        GLsizei stride = vertexFormat(layout).stride;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)a.vertexOffset * stride, vertexCount * stride, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // the element buffer binding belongs to the VAO, bind it through a copy target instead
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)a.indexOffset * indexSize(indexType), indexCount * indexSize(indexType), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        GLuint id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+            allocations[id] = a;
+        }
+        else {
+            id = (GLuint)allocations.size();
+            allocations.push_back(a);
+        }
+        return id;
+    }
+
+    void free(GLuint id)
+    {
+        Allocation& a = allocations[id];
+        if (!a.live)
+            return;
+        vertexSpace.free(a.vertexOffset, a.vertexCount);
+        indexSpace.free(a.indexOffset, a.indexCount);
+        a.live = false;
+        freeIds.push_back(id);
+    }
+
+    const Allocation& allocation(GLuint id) const
+    {
+        return allocations[id];
+    }
+
+    GLuint getVAO() const
+    {
+        return this->VAO;
+    }
+
+    GLenum getIndexType() const
+    {
+        return this->indexType;
+    }
+
+    // how often the buffers were reallocated to grow / to compact
+    size_t getGrowths() const
+    {
+        return this->growths;
+    }
+
+    size_t getCompactions() const
+    {
+        return this->compactions;
+    }
+
+private:
+    VertexLayout layout;
+    GLenum indexType;
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    RangeAllocator vertexSpace, indexSpace;
+    vector<Allocation> allocations;
+    vector<GLuint> freeIds;
+    size_t growths = 0, compactions = 0;
+
+    size_t elementSize(bool vertexBuffer) const
+    {
+        return vertexBuffer ? vertexFormat(layout).stride : indexSize(indexType);
+    }
+
+    void create()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        vertexSpace.reset(INITIAL_VERTICES);
+        indexSpace.reset(INITIAL_INDICES);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTICES * elementSize(true), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, INITIAL_INDICES * elementSize(false), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        bindBuffers();
+    }
+
+    // points the VAO at the current buffers, after create and after a rebuild replaced one
+    void bindBuffers()
+    {
+        const VertexFormat& format = vertexFormat(layout);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        for (const VertexAttribute& attribute: format.attributes) {
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, format.stride, (void*)(size_t)attribute.offset);
+            glEnableVertexAttribArray(attribute.location);
+        }
+        // the instance attributes are only enabled by Mesh::DrawInstanced, the divisor is kept by the VAO
+        for (const VertexAttribute& attribute: instanceFormat().attributes)
+            glVertexAttribDivisor(attribute.location, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // moves the live ranges of one buffer, in offset order, to the front of a new buffer of capacity elements
+    void rebuild(bool vertexBuffer, size_t capacity)
+    {
+        size_t size = elementSize(vertexBuffer);
+        GLuint& buffer = vertexBuffer ? VBO : EBO;
+        GLuint fresh;
+        glGenBuffers(1, &fresh);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, fresh);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * size, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+        vector<Allocation*> live;
+        for (Allocation& a: allocations)
+            if (a.live)
+                live.push_back(&a);
+        sort(live.begin(), live.end(), [vertexBuffer](const Allocation* x, const Allocation* y) {
+            return vertexBuffer ? x->vertexOffset < y->vertexOffset : x->indexOffset < y->indexOffset;
+        });
+
+        size_t offset = 0;
+        for (Allocation* a: live) {
+            GLuint& from = vertexBuffer ? a->vertexOffset : a->indexOffset;
+            GLuint count = vertexBuffer ? a->vertexCount : a->indexCount;
+            if (count > 0)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)from * size, (GLintptr)offset * size, (GLsizeiptr)count * size);
+            from = (GLuint)offset;
+            offset += count;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = fresh;
+        bindBuffers();
+
+        RangeAllocator& space = vertexBuffer ? vertexSpace : indexSpace;
+        space.reset(capacity);
+        space.allocate(offset);
+    }
+
+    // makes room for size elements in one buffer, compacting when that is enough and growing otherwise
+    size_t reserve(bool vertexBuffer, size_t size)
+    {
+        RangeAllocator& space = vertexBuffer ? vertexSpace : indexSpace;
+        size_t offset = space.allocate(size);
+        if (offset != RangeAllocator::NONE)
+            return offset;
+
+        size_t capacity = space.getCapacity();
+        // compacting only pays when it leaves a good amount of space behind the new range
+        if (space.freeSpace() >= size + capacity / 4) {
+            rebuild(vertexBuffer, capacity);
+            ++compactions;
+        }
+        else {
+            rebuild(vertexBuffer, max(capacity * 2, capacity - space.freeSpace() + size + capacity / 4));
+            ++growths;
+        }
+        return space.allocate(size);
+    }
+};
+
+// the arena of every layout and index type, meshes are placed in it by Mesh::setupMesh
+inline GeometryArena& geometryArena(VertexLayout layout, GLenum indexType)
+{
+    static map<pair<VertexLayout, GLenum>, unique_ptr<GeometryArena>> arenas;
+    unique_ptr<GeometryArena>& arena = arenas[make_pair(layout, indexType)];
+    if (!arena)
+        arena.reset(new GeometryArena(layout, indexType));
+    return *arena;
+}
+
+#endif
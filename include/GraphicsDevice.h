@@ -0,0 +1,788 @@
+#ifndef GRAPHICSDEVICE_H
+#define GRAPHICSDEVICE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// KHR_parallel_shader_compile is not part of glad's core profile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// whether the current context lists the extension name (e.g. "GL_ARB_buffer_storage"). glad only loads the core
+// entry points, the loaders of optional features load the extension ones themselves once this finds them
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i), name) == 0)
+            return true;
+    return false;
+}
+
+// Where the GL entry points of the engine go. The engine calls GL through glad's function pointers, so a backend is a
+// set of those pointers: GRAPHICS_OPENGL loads the driver's, GRAPHICS_NULL points them at a device that draws nothing
+// and records what it was asked to do (see GraphicsStats). With the null device the whole frame pipeline (shaders,
+// geometry arena, render queue, culling, lights, upload ring) runs without a context, e.g. in benchmarks on machines
+// without a GPU, and its state changes can be counted exactly.
+enum GraphicsBackend {
+    GRAPHICS_OPENGL,
+    GRAPHICS_NULL
+};
+
+// what the null device was asked to do since the last resetGraphicsStats
+struct GraphicsStats {
+    // draw calls, and the draws in them (a multi-draw counts each of its commands)
+    size_t drawCalls = 0, draws = 0;
+    size_t instances = 0, triangles = 0;
+    size_t programBinds = 0, vertexArrayBinds = 0, bufferBinds = 0, textureBinds = 0;
+    size_t uniformUploads = 0;
+    // bytes given to glBufferData / glBufferSubData / glBufferStorage and written through non persistent maps
+    size_t bytesUploaded = 0;
+    size_t objectsCreated = 0, objectsDeleted = 0;
+    // GLSL compiled and linked, and programs restored from a binary
+    size_t shaderCompiles = 0, programLinks = 0, programBinaries = 0;
+};
+
+// The state of the null device: object names, a CPU copy of every buffer (so maps and indirect draws work),
+// and the uniforms and uniform blocks declared in the shader sources, reported as the program's active ones.
+// Like a GL context it belongs to one thread.
+struct NullGraphicsDevice {
+    struct UniformInfo {
+        string name;
+        GLenum type;
+        GLint size;
+    };
+
+    struct BlockInfo {
+        string name;
+        GLint dataSize;
+    };
+
+    struct Program {
+        vector<GLuint> shaders;
+        vector<UniformInfo> uniforms;
+        vector<BlockInfo> blocks;
+        // the sources it was linked from, which is what its binary holds
+        string binary;
+        bool linked = false;
+    };
+
+    GraphicsStats stats;
+    GLuint nextName = 1;
+    uintptr_t nextSync = 1;
+    map<GLuint, vector<unsigned char>> buffers;
+    map<GLenum, GLuint> bindings;
+    map<GLuint, string> sources;
+    map<GLuint, Program> programs;
+    GLuint currentProgram = 0;
+    // the results of timestamp queries
+    map<GLuint, GLuint64> timestamps;
+    // what glGetString(GL_VERSION) reports
+    string version;
+    // bytes of the last map that is not persistent, counted as uploaded when it is unmapped
+    GLsizeiptr mappedBytes = 0;
+};
+
+inline NullGraphicsDevice& nullGraphicsDevice()
+{
+    static NullGraphicsDevice device;
+    return device;
+}
+
+inline const GraphicsStats& graphicsStats()
+{
+    return nullGraphicsDevice().stats;
+}
+
+inline void resetGraphicsStats()
+{
+    nullGraphicsDevice().stats = GraphicsStats();
+}
+
+// GL type and std140 size of a GLSL type name, GL_NONE for the ones that are not basic types (structs)
+inline GLenum glslType(const string& name, GLint* size = nullptr)
+{
+    static const struct { const char* name; GLenum type; GLint size; } types[] = {
+        {"float", GL_FLOAT, 4}, {"vec2", GL_FLOAT_VEC2, 8}, {"vec3", GL_FLOAT_VEC3, 16}, {"vec4", GL_FLOAT_VEC4, 16},
+        {"int", GL_INT, 4}, {"ivec2", GL_INT_VEC2, 8}, {"ivec3", GL_INT_VEC3, 16}, {"ivec4", GL_INT_VEC4, 16},
+        {"uint", GL_UNSIGNED_INT, 4}, {"uvec2", GL_UNSIGNED_INT_VEC2, 8}, {"uvec3", GL_UNSIGNED_INT_VEC3, 16},
+        {"uvec4", GL_UNSIGNED_INT_VEC4, 16}, {"bool", GL_BOOL, 4},
+        {"mat3", GL_FLOAT_MAT3, 48}, {"mat4", GL_FLOAT_MAT4, 64},
+        {"sampler2D", GL_SAMPLER_2D, 4}, {"samplerCube", GL_SAMPLER_CUBE, 4}, {"samplerBuffer", GL_SAMPLER_BUFFER, 4},
+        {"isamplerBuffer", GL_INT_SAMPLER_BUFFER, 4}, {"usamplerBuffer", GL_UNSIGNED_INT_SAMPLER_BUFFER, 4}
+    };
+    for (const auto& t: types) {
+        if (name == t.name) {
+            if (size != nullptr)
+                *size = t.size;
+            return t.type;
+        }
+    }
+    return GL_NONE;
+}
+
+// Finds the uniforms (struct uniforms as their members) and uniform blocks declared in GLSL source, the way a
+// linker lists the active ones. Good enough for the engine's shaders: no nested structs, one name per declaration.
+inline void reflectGlsl(const string& source, NullGraphicsDevice::Program& program)
+{
+    // tokens, without comments and preprocessor lines
+    vector<string> tokens;
+    for (size_t i = 0; i < source.size();) {
+        char c = source[i];
+        if (source.compare(i, 2, "//") == 0 || c == '#') {
+            i = source.find('\n', i);
+            i = i == string::npos ? source.size() : i;
+        }
+        else if (source.compare(i, 2, "/*") == 0) {
+            i = source.find("*/", i + 2);
+            i = i == string::npos ? source.size() : i + 2;
+        }
+        else if (isalnum((unsigned char)c) || c == '_') {
+            size_t start = i;
+            while (i < source.size() && (isalnum((unsigned char)source[i]) || source[i] == '_'))
+                ++i;
+            tokens.push_back(source.substr(start, i - start));
+        }
+        else {
+            if (!isspace((unsigned char)c))
+                tokens.push_back(string(1, c));
+            ++i;
+        }
+    }
+
+    map<string, vector<pair<string, string>>> structs;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i] == "struct" && i + 2 < tokens.size() && tokens[i + 2] == "{") {
+            vector<pair<string, string>>& fields = structs[tokens[i + 1]];
+            fields.clear();
+            size_t j = i + 3;
+            while (j + 2 < tokens.size() && tokens[j] != "}") {
+                fields.push_back(make_pair(tokens[j], tokens[j + 1]));
+                while (j < tokens.size() && tokens[j] != ";")
+                    ++j;
+                ++j;
+            }
+            i = j;
+            continue;
+        }
+        if (tokens[i] != "uniform" || i + 2 >= tokens.size())
+            continue;
+
+        // a block: uniform Name { members } [instance];
+        if (tokens[i + 2] == "{") {
+            NullGraphicsDevice::BlockInfo block{tokens[i + 1], 0};
+            size_t j = i + 3;
+            while (j + 2 < tokens.size() && tokens[j] != "}") {
+                GLint size = 16;
+                glslType(tokens[j], &size);
+                // std140: vectors of 3 and 4 and matrix columns on 16 bytes
+                GLint alignment = size >= 16 ? 16 : size;
+                block.dataSize = (block.dataSize + alignment - 1) / alignment * alignment + size;
+                while (j < tokens.size() && tokens[j] != ";")
+                    ++j;
+                ++j;
+            }
+            block.dataSize = (block.dataSize + 15) / 16 * 16;
+            bool known = false;
+            for (const NullGraphicsDevice::BlockInfo& b: program.blocks)
+                known = known || b.name == block.name;
+            if (!known)
+                program.blocks.push_back(block);
+            i = j;
+            continue;
+        }
+
+        // uniform [precision] type name [n];
+        size_t t = i + 1;
+        if (tokens[t] == "lowp" || tokens[t] == "mediump" || tokens[t] == "highp")
+            ++t;
+        if (t + 1 >= tokens.size())
+            continue;
+        const string& type = tokens[t];
+        const string& name = tokens[t + 1];
+        GLint size = 1;
+        if (t + 4 < tokens.size() && tokens[t + 2] == "[")
+            size = max(atoi(tokens[t + 3].c_str()), 1);
+
+        vector<NullGraphicsDevice::UniformInfo> declared;
+        auto it = structs.find(type);
+        if (it != structs.end())
+            for (const auto& field: it->second)
+                declared.push_back(NullGraphicsDevice::UniformInfo{name + "." + field.second, glslType(field.first), 1});
+        else
+            declared.push_back(NullGraphicsDevice::UniformInfo{size > 1 ? name + "[0]" : name, glslType(type), size});
+        for (const NullGraphicsDevice::UniformInfo& uniform: declared) {
+            bool known = false;
+            for (const NullGraphicsDevice::UniformInfo& u: program.uniforms)
+                known = known || u.name == uniform.name;
+            if (!known)
+                program.uniforms.push_back(uniform);
+        }
+    }
+}
+
+// the entry points of the null device, one per GL function the engine calls; a function without one here is left
+// NULL by loadGraphicsBackend(GRAPHICS_NULL), so a new GL call in the engine needs its stub added
+inline void APIENTRY nullGenNames(GLsizei n, GLuint* names)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    for (GLsizei i = 0; i < n; ++i)
+        names[i] = device.nextName++;
+    device.stats.objectsCreated += (size_t)n;
+}
+
+inline void APIENTRY nullDeleteNames(GLsizei n, const GLuint* names)
+{
+    (void)names;
+    nullGraphicsDevice().stats.objectsDeleted += (size_t)n;
+}
+
+inline void APIENTRY nullDeleteBuffers(GLsizei n, const GLuint* names)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    for (GLsizei i = 0; i < n; ++i)
+        device.buffers.erase(names[i]);
+    device.stats.objectsDeleted += (size_t)n;
+}
+
+inline vector<unsigned char>& nullBoundBuffer(GLenum target)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    return device.buffers[device.bindings[target]];
+}
+
+inline void APIENTRY nullBindBuffer(GLenum target, GLuint buffer)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    device.bindings[target] = buffer;
+    ++device.stats.bufferBinds;
+}
+
+inline void APIENTRY nullBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    (void)index;
+    nullBindBuffer(target, buffer);
+}
+
+inline void APIENTRY nullBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    (void)index, (void)offset, (void)size;
+    nullBindBuffer(target, buffer);
+}
+
+inline void APIENTRY nullBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    (void)usage;
+    vector<unsigned char>& buffer = nullBoundBuffer(target);
+    buffer.assign((size_t)size, 0);
+    if (data != NULL) {
+        memcpy(buffer.data(), data, (size_t)size);
+        nullGraphicsDevice().stats.bytesUploaded += (size_t)size;
+    }
+}
+
+inline void APIENTRY nullBufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+    (void)flags;
+    nullBufferData(target, size, data, GL_STATIC_DRAW);
+}
+
+inline void APIENTRY nullBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    vector<unsigned char>& buffer = nullBoundBuffer(target);
+    if ((size_t)(offset + size) <= buffer.size())
+        memcpy(buffer.data() + offset, data, (size_t)size);
+    nullGraphicsDevice().stats.bytesUploaded += (size_t)size;
+}
+
+inline void APIENTRY nullCopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+{
+    vector<unsigned char>& from = nullBoundBuffer(readTarget);
+    vector<unsigned char>& to = nullBoundBuffer(writeTarget);
+    if ((size_t)(readOffset + size) <= from.size() && (size_t)(writeOffset + size) <= to.size())
+        memmove(to.data() + writeOffset, from.data() + readOffset, (size_t)size);
+}
+
+inline void* APIENTRY nullMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    vector<unsigned char>& buffer = nullBoundBuffer(target);
+    if ((size_t)(offset + length) > buffer.size())
+        return NULL;
+    nullGraphicsDevice().mappedBytes = (access & GL_MAP_PERSISTENT_BIT) ? 0 : length;
+    return buffer.data() + offset;
+}
+
+inline GLboolean APIENTRY nullUnmapBuffer(GLenum target)
+{
+    (void)target;
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    device.stats.bytesUploaded += (size_t)device.mappedBytes;
+    device.mappedBytes = 0;
+    return GL_TRUE;
+}
+
+inline void APIENTRY nullBindVertexArray(GLuint array)
+{
+    (void)array;
+    ++nullGraphicsDevice().stats.vertexArrayBinds;
+}
+
+inline void APIENTRY nullBindTexture(GLenum target, GLuint texture)
+{
+    (void)target, (void)texture;
+    ++nullGraphicsDevice().stats.textureBinds;
+}
+
+inline void APIENTRY nullUseProgram(GLuint program)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    device.currentProgram = program;
+    ++device.stats.programBinds;
+}
+
+inline void nullDraw(GLsizei count, GLsizei instances)
+{
+    GraphicsStats& stats = nullGraphicsDevice().stats;
+    ++stats.draws;
+    stats.instances += (size_t)instances;
+    stats.triangles += (size_t)(count / 3) * (size_t)instances;
+}
+
+inline void APIENTRY nullDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex)
+{
+    (void)mode, (void)type, (void)indices, (void)baseVertex;
+    ++nullGraphicsDevice().stats.drawCalls;
+    nullDraw(count, 1);
+}
+
+inline void APIENTRY nullDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances)
+{
+    (void)mode, (void)type, (void)indices;
+    ++nullGraphicsDevice().stats.drawCalls;
+    nullDraw(count, instances);
+}
+
+inline void APIENTRY nullDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances, GLint baseVertex)
+{
+    (void)baseVertex;
+    nullDrawElementsInstanced(mode, count, type, indices, instances);
+}
+
+// reads the commands from the CPU copy of the bound indirect buffer, as the GPU would
+inline void APIENTRY nullMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride)
+{
+    (void)mode, (void)type;
+    ++nullGraphicsDevice().stats.drawCalls;
+    const vector<unsigned char>& buffer = nullBoundBuffer(GL_DRAW_INDIRECT_BUFFER);
+    size_t step = stride != 0 ? (size_t)stride : 5 * sizeof(GLuint);
+    for (GLsizei i = 0; i < drawCount; ++i) {
+        size_t offset = (size_t)indirect + i * step;
+        GLuint command[2] = {0, 0};
+        if (offset + sizeof(command) <= buffer.size())
+            memcpy(command, buffer.data() + offset, sizeof(command));
+        nullDraw((GLsizei)command[0], (GLsizei)command[1]);
+    }
+}
+
+inline void APIENTRY nullUniform1i(GLint location, GLint v0)
+{
+    (void)location, (void)v0;
+    ++nullGraphicsDevice().stats.uniformUploads;
+}
+
+inline void APIENTRY nullUniform1f(GLint location, GLfloat v0)
+{
+    (void)location, (void)v0;
+    ++nullGraphicsDevice().stats.uniformUploads;
+}
+
+inline void APIENTRY nullUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    (void)location, (void)v0, (void)v1, (void)v2;
+    ++nullGraphicsDevice().stats.uniformUploads;
+}
+
+inline void APIENTRY nullUniformMatrixfv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    (void)location, (void)count, (void)transpose, (void)value;
+    ++nullGraphicsDevice().stats.uniformUploads;
+}
+
+inline GLuint APIENTRY nullCreateShader(GLenum type)
+{
+    (void)type;
+    GLuint name;
+    nullGenNames(1, &name);
+    return name;
+}
+
+inline GLuint APIENTRY nullCreateProgram()
+{
+    GLuint name;
+    nullGenNames(1, &name);
+    return name;
+}
+
+inline void APIENTRY nullShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* length)
+{
+    string& source = nullGraphicsDevice().sources[shader];
+    source.clear();
+    for (GLsizei i = 0; i < count; ++i)
+        source += length != NULL && length[i] >= 0 ? string(strings[i], (size_t)length[i]) : string(strings[i]);
+}
+
+inline void APIENTRY nullCompileShader(GLuint shader)
+{
+    (void)shader;
+    ++nullGraphicsDevice().stats.shaderCompiles;
+}
+
+inline void APIENTRY nullDeleteShader(GLuint shader)
+{
+    nullDeleteNames(1, &shader);
+}
+
+inline void APIENTRY nullAttachShader(GLuint program, GLuint shader)
+{
+    nullGraphicsDevice().programs[program].shaders.push_back(shader);
+}
+
+inline void APIENTRY nullLinkProgram(GLuint program)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    NullGraphicsDevice::Program& linked = device.programs[program];
+    linked.uniforms.clear();
+    linked.blocks.clear();
+    linked.binary.clear();
+    for (GLuint shader: linked.shaders) {
+        reflectGlsl(device.sources[shader], linked);
+        linked.binary += device.sources[shader] + '\0';
+    }
+    linked.linked = true;
+    ++device.stats.programLinks;
+}
+
+// a binary is the sources of the program, in the one format NULL_PROGRAM_BINARY
+const GLenum NULL_PROGRAM_BINARY = 0x4E554C4C;
+
+inline void APIENTRY nullGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary)
+{
+    const string& data = nullGraphicsDevice().programs[program].binary;
+    GLsizei size = min(bufSize, (GLsizei)data.size());
+    memcpy(binary, data.data(), (size_t)size);
+    if (length != NULL)
+        *length = size;
+    *binaryFormat = NULL_PROGRAM_BINARY;
+}
+
+// links the program from the sources in binary, a binary of another format fails to link
+inline void APIENTRY nullProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length)
+{
+    NullGraphicsDevice& device = nullGraphicsDevice();
+    NullGraphicsDevice::Program& linked = device.programs[program];
+    linked.uniforms.clear();
+    linked.blocks.clear();
+    linked.binary.assign((const char*)binary, (size_t)length);
+    linked.linked = binaryFormat == NULL_PROGRAM_BINARY && !linked.binary.empty() && linked.binary.back() == '\0';
+    if (!linked.linked)
+        return;
+    for (size_t begin = 0, end; begin < linked.binary.size(); begin = end + 1) {
+        end = linked.binary.find('\0', begin);
+        reflectGlsl(linked.binary.substr(begin, end - begin), linked);
+    }
+    ++device.stats.programBinaries;
+}
+
+inline void APIENTRY nullProgramParameteri(GLuint program, GLenum pname, GLint value)
+{
+    (void)program, (void)pname, (void)value;
+}
+
+inline const GLubyte* APIENTRY nullGetString(GLenum name)
+{
+    if (name == GL_VERSION)
+        return (const GLubyte*)nullGraphicsDevice().version.c_str();
+    return (const GLubyte*)(name == GL_VENDOR ? "null" : name == GL_RENDERER ? "null graphics device" : "");
+}
+
+// every compile and link succeeds
+inline void APIENTRY nullGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+    (void)shader;
+    *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+
+inline void APIENTRY nullGetInfoLog(GLuint object, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+    (void)object;
+    if (bufSize > 0)
+        infoLog[0] = '\0';
+    if (length != NULL)
+        *length = 0;
+}
+
+inline void APIENTRY nullGetProgramiv(GLuint program, GLenum pname, GLint* params)
+{
+    const NullGraphicsDevice::Program& linked = nullGraphicsDevice().programs[program];
+    *params = 0;
+    if (pname == GL_LINK_STATUS)
+        *params = linked.linked ? GL_TRUE : GL_FALSE;
+    else if (pname == GL_COMPLETION_STATUS_KHR)
+        *params = GL_TRUE;
+    else if (pname == GL_PROGRAM_BINARY_LENGTH)
+        *params = (GLint)linked.binary.size();
+    else if (pname == GL_ACTIVE_UNIFORMS)
+        *params = (GLint)linked.uniforms.size();
+    else if (pname == GL_ACTIVE_UNIFORM_BLOCKS)
+        *params = (GLint)linked.blocks.size();
+    else if (pname == GL_ACTIVE_UNIFORM_MAX_LENGTH)
+        for (const NullGraphicsDevice::UniformInfo& uniform: linked.uniforms)
+            *params = max(*params, (GLint)uniform.name.size() + 1);
+}
+
+inline void nullCopyName(const string& name, GLsizei bufSize, GLsizei* length, GLchar* target)
+{
+    GLsizei copied = bufSize > 0 ? min((GLsizei)name.size(), bufSize - 1) : 0;
+    if (bufSize > 0) {
+        memcpy(target, name.data(), (size_t)copied);
+        target[copied] = '\0';
+    }
+    if (length != NULL)
+        *length = copied;
+}
+
+inline void APIENTRY nullGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+{
+    const NullGraphicsDevice::UniformInfo& uniform = nullGraphicsDevice().programs[program].uniforms.at(index);
+    nullCopyName(uniform.name, bufSize, length, name);
+    *size = uniform.size;
+    *type = uniform.type;
+}
+
+// the location of a uniform is its index, the members of blocks are not listed so they have none
+inline GLint APIENTRY nullGetUniformLocation(GLuint program, const GLchar* name)
+{
+    const vector<NullGraphicsDevice::UniformInfo>& uniforms = nullGraphicsDevice().programs[program].uniforms;
+    for (size_t i = 0; i < uniforms.size(); ++i)
+        if (uniforms[i].name == name)
+            return (GLint)i;
+    return -1;
+}
+
+inline void APIENTRY nullGetActiveUniformBlockiv(GLuint program, GLuint index, GLenum pname, GLint* params)
+{
+    const NullGraphicsDevice::BlockInfo& block = nullGraphicsDevice().programs[program].blocks.at(index);
+    *params = pname == GL_UNIFORM_BLOCK_NAME_LENGTH ? (GLint)block.name.size() + 1 : pname == GL_UNIFORM_BLOCK_DATA_SIZE ? block.dataSize : 0;
+}
+
+inline void APIENTRY nullGetActiveUniformBlockName(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLchar* name)
+{
+    nullCopyName(nullGraphicsDevice().programs[program].blocks.at(index).name, bufSize, length, name);
+}
+
+inline void APIENTRY nullUniformBlockBinding(GLuint program, GLuint index, GLuint binding)
+{
+    (void)program, (void)index, (void)binding;
+}
+
+// the limits of a typical desktop driver, no extensions
+inline void APIENTRY nullGetIntegerv(GLenum pname, GLint* data)
+{
+    switch (pname) {
+    case GL_MAX_TEXTURE_BUFFER_SIZE:
+        *data = 1 << 27;
+        break;
+    case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+        *data = 256;
+        break;
+    case GL_NUM_PROGRAM_BINARY_FORMATS:
+        *data = GLAD_GL_VERSION_4_1 ? 1 : 0;
+        break;
+    case GL_CURRENT_PROGRAM:
+        *data = (GLint)nullGraphicsDevice().currentProgram;
+        break;
+    default:
+        *data = 0;
+    }
+}
+
+inline const GLubyte* APIENTRY nullGetStringi(GLenum name, GLuint index)
+{
+    (void)name, (void)index;
+    return (const GLubyte*)"";
+}
+
+// the GPU is always done
+inline GLsync APIENTRY nullFenceSync(GLenum condition, GLbitfield flags)
+{
+    (void)condition, (void)flags;
+    return (GLsync)nullGraphicsDevice().nextSync++;
+}
+
+inline GLenum APIENTRY nullClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    (void)sync, (void)flags, (void)timeout;
+    return GL_ALREADY_SIGNALED;
+}
+
+inline void APIENTRY nullDeleteSync(GLsync sync)
+{
+    (void)sync;
+}
+
+// the GPU clock is the CPU's steady clock, and a timestamp is taken when the command is issued
+inline GLuint64 nullTimestamp()
+{
+    return (GLuint64)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void APIENTRY nullQueryCounter(GLuint id, GLenum target)
+{
+    (void)target;
+    nullGraphicsDevice().timestamps[id] = nullTimestamp();
+}
+
+inline void APIENTRY nullGetQueryObjectiv(GLuint id, GLenum pname, GLint* params)
+{
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? 1 : (GLint)nullGraphicsDevice().timestamps[id];
+}
+
+inline void APIENTRY nullGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params)
+{
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? 1 : nullGraphicsDevice().timestamps[id];
+}
+
+inline void APIENTRY nullGetInteger64v(GLenum pname, GLint64* data)
+{
+    *data = pname == GL_TIMESTAMP ? (GLint64)nullTimestamp() : 0;
+}
+
+// the calls that only change state the null device does not track
+inline void APIENTRY nullEnum(GLenum a) { (void)a; }
+inline void APIENTRY nullEnumEnum(GLenum a, GLenum b) { (void)a, (void)b; }
+inline void APIENTRY nullEnumEnumUint(GLenum a, GLenum b, GLuint c) { (void)a, (void)b, (void)c; }
+inline void APIENTRY nullUint(GLuint a) { (void)a; }
+inline void APIENTRY nullUintUint(GLuint a, GLuint b) { (void)a, (void)b; }
+inline void APIENTRY nullBitfield(GLbitfield a) { (void)a; }
+inline void APIENTRY nullFloat4(GLfloat a, GLfloat b, GLfloat c, GLfloat d) { (void)a, (void)b, (void)c, (void)d; }
+inline void APIENTRY nullInt4(GLint a, GLint b, GLsizei c, GLsizei d) { (void)a, (void)b, (void)c, (void)d; }
+
+inline void APIENTRY nullVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+    (void)index, (void)size, (void)type, (void)normalized, (void)stride, (void)pointer;
+}
+
+inline void APIENTRY nullVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)
+{
+    (void)index, (void)size, (void)type, (void)stride, (void)pointer;
+}
+
+// Points glad's function pointers at backend. GRAPHICS_OPENGL loads the driver through load (a context has to be
+// current); GRAPHICS_NULL needs neither and reports GL version major.minor, which picks the paths the engine takes
+// (e.g. 4.3 for multi-draw indirect, 4.4 for the persistently mapped upload ring). Returns false when loading failed.
+inline bool loadGraphicsBackend(GraphicsBackend backend, GLADloadproc load, int major = 3, int minor = 3)
+{
+    if (backend == GRAPHICS_OPENGL)
+        return gladLoadGLLoader(load) != 0;
+
+    // the device keeps its objects when it is loaded again, GL objects the engine holds in statics (e.g. the
+    // geometry arenas) live on
+    int version = major * 10 + minor;
+    nullGraphicsDevice().version = to_string(major) + "." + to_string(minor) + " null";
+    int* versions[] = {&GLAD_GL_VERSION_1_0, &GLAD_GL_VERSION_1_1, &GLAD_GL_VERSION_1_2, &GLAD_GL_VERSION_1_3, &GLAD_GL_VERSION_1_4,
+        &GLAD_GL_VERSION_1_5, &GLAD_GL_VERSION_2_0, &GLAD_GL_VERSION_2_1, &GLAD_GL_VERSION_3_0, &GLAD_GL_VERSION_3_1,
+        &GLAD_GL_VERSION_3_2, &GLAD_GL_VERSION_3_3, &GLAD_GL_VERSION_4_0, &GLAD_GL_VERSION_4_1, &GLAD_GL_VERSION_4_2,
+        &GLAD_GL_VERSION_4_3, &GLAD_GL_VERSION_4_4, &GLAD_GL_VERSION_4_5, &GLAD_GL_VERSION_4_6};
+    int numbers[] = {10, 11, 12, 13, 14, 15, 20, 21, 30, 31, 32, 33, 40, 41, 42, 43, 44, 45, 46};
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+        *versions[i] = numbers[i] <= version;
+
+    glad_glGenBuffers = nullGenNames;
+    glad_glGenTextures = nullGenNames;
+    glad_glGenVertexArrays = nullGenNames;
+    glad_glDeleteBuffers = nullDeleteBuffers;
+    glad_glDeleteTextures = nullDeleteNames;
+    glad_glDeleteVertexArrays = nullDeleteNames;
+    glad_glBindBuffer = nullBindBuffer;
+    glad_glBindBufferBase = nullBindBufferBase;
+    glad_glBindBufferRange = nullBindBufferRange;
+    glad_glBufferData = nullBufferData;
+    glad_glBufferSubData = nullBufferSubData;
+    glad_glCopyBufferSubData = nullCopyBufferSubData;
+    glad_glMapBufferRange = nullMapBufferRange;
+    glad_glUnmapBuffer = nullUnmapBuffer;
+    glad_glBindVertexArray = nullBindVertexArray;
+    glad_glBindTexture = nullBindTexture;
+    glad_glActiveTexture = nullEnum;
+    glad_glTexBuffer = nullEnumEnumUint;
+    glad_glUseProgram = nullUseProgram;
+    glad_glDrawElementsBaseVertex = nullDrawElementsBaseVertex;
+    glad_glDrawElementsInstanced = nullDrawElementsInstanced;
+    glad_glDrawElementsInstancedBaseVertex = nullDrawElementsInstancedBaseVertex;
+    glad_glVertexAttribPointer = nullVertexAttribPointer;
+    glad_glVertexAttribIPointer = nullVertexAttribIPointer;
+    glad_glVertexAttribDivisor = nullUintUint;
+    glad_glEnableVertexAttribArray = nullUint;
+    glad_glDisableVertexAttribArray = nullUint;
+    glad_glUniform1i = nullUniform1i;
+    glad_glUniform1f = nullUniform1f;
+    glad_glUniform3f = nullUniform3f;
+    glad_glUniformMatrix3fv = nullUniformMatrixfv;
+    glad_glUniformMatrix4fv = nullUniformMatrixfv;
+    glad_glCreateShader = nullCreateShader;
+    glad_glShaderSource = nullShaderSource;
+    glad_glCompileShader = nullCompileShader;
+    glad_glGetShaderiv = nullGetShaderiv;
+    glad_glGetShaderInfoLog = nullGetInfoLog;
+    glad_glDeleteShader = nullDeleteShader;
+    glad_glCreateProgram = nullCreateProgram;
+    glad_glAttachShader = nullAttachShader;
+    glad_glLinkProgram = nullLinkProgram;
+    glad_glGetProgramiv = nullGetProgramiv;
+    glad_glGetProgramInfoLog = nullGetInfoLog;
+    glad_glDeleteProgram = nullUint;
+    glad_glGetActiveUniform = nullGetActiveUniform;
+    glad_glGetUniformLocation = nullGetUniformLocation;
+    glad_glGetActiveUniformBlockiv = nullGetActiveUniformBlockiv;
+    glad_glGetActiveUniformBlockName = nullGetActiveUniformBlockName;
+    glad_glUniformBlockBinding = nullUniformBlockBinding;
+    glad_glGetIntegerv = nullGetIntegerv;
+    glad_glGetString = nullGetString;
+    glad_glGetStringi = nullGetStringi;
+    glad_glFenceSync = nullFenceSync;
+    glad_glClientWaitSync = nullClientWaitSync;
+    glad_glDeleteSync = nullDeleteSync;
+    glad_glGenQueries = nullGenNames;
+    glad_glDeleteQueries = nullDeleteNames;
+    glad_glQueryCounter = nullQueryCounter;
+    glad_glGetQueryObjectiv = nullGetQueryObjectiv;
+    glad_glGetQueryObjectui64v = nullGetQueryObjectui64v;
+    glad_glGetInteger64v = nullGetInteger64v;
+    glad_glEnable = nullEnum;
+    glad_glDisable = nullEnum;
+    glad_glPolygonMode = nullEnumEnum;
+    glad_glClear = nullBitfield;
+    glad_glClearColor = nullFloat4;
+    glad_glViewport = nullInt4;
+    glad_glBufferStorage = version >= 44 ? nullBufferStorage : NULL;
+    glad_glMultiDrawElementsIndirect = version >= 43 ? nullMultiDrawElementsIndirect : NULL;
+    glad_glGetProgramBinary = version >= 41 ? nullGetProgramBinary : NULL;
+    glad_glProgramBinary = version >= 41 ? nullProgramBinary : NULL;
+    glad_glProgramParameteri = version >= 41 ? nullProgramParameteri : NULL;
+    return true;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef INDIRECTDRAW_H
+#define INDIRECTDRAW_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GraphicsDevice.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// one draw of glMultiDrawElementsIndirect, laid out as the GL reads it from the command buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    // the index of the draw, which reaches the shader through the draw index attribute
+    GLuint baseInstance;
+};
+
+// What the vertex shader fetches from drawRecords for a draw, texels of an RGBA32F buffer texture.
+// It replaces the model, normalMatrix, positionScale and positionOffset uniforms of a plain draw.
+struct DrawRecord {
+    glm::vec4 model[4];
+    // columns of the normal matrix, w unused
+    glm::vec4 normalMatrix[3];
+    // w holds the index of the material in materialTable
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+};
+
+// a material in materialTable, shininess in the w of ambient
+struct MaterialRecord {
+    glm::vec4 ambient, diffuse, specular;
+};
+
+// texels per record, shader.vs has them written out (9 and 3)
+const GLuint DRAW_RECORD_TEXELS = sizeof(DrawRecord) / sizeof(glm::vec4);
+const GLuint MATERIAL_RECORD_TEXELS = sizeof(MaterialRecord) / sizeof(glm::vec4);
+static_assert(DRAW_RECORD_TEXELS == 9 && MATERIAL_RECORD_TEXELS == 3, "shader.vs reads 9 texels per draw and 3 per material");
+
+// attribute location of the draw index, an integer per instance read from the buffer 0, 1, 2, ...
+// so the baseInstance of a command picks its own element
+const GLuint DRAW_INDEX_LOCATION = 9;
+
+// Whether glMultiDrawElementsIndirect (with baseInstance) can be used: always on GL 4.3, and on older contexts with
+// ARB_multi_draw_indirect and ARB_base_instance.
+inline bool loadMultiDrawIndirect(GLADloadproc load)
+{
+    if (GLAD_GL_VERSION_4_3)
+        return true;
+    if (!hasGLExtension("GL_ARB_multi_draw_indirect") || !hasGLExtension("GL_ARB_base_instance"))
+        return false;
+    glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+    return glad_glMultiDrawElementsIndirect != NULL;
+}
+
+// The GL objects of the multi-draw-indirect path: the command buffer, the draw records and the material table
+// (buffer textures, so #version 330 shaders can read them with texelFetch), and the draw index buffer.
+// RenderQueue fills them once per frame, the streamed ones are orphaned so the upload never waits for the GPU.
+class IndirectDrawBuffers
+{
+public:
+    IndirectDrawBuffers() = default;
+    IndirectDrawBuffers(const IndirectDrawBuffers&) = delete;
+    IndirectDrawBuffers& operator =(const IndirectDrawBuffers&) = delete;
+
+    // the most draw records the buffer texture can address, the driver minimum is 65536 texels
+    size_t getMaxDraws()
+    {
+        if (commandBuffer == 0)
+            create();
+        return maxDraws;
+    }
+
+    // uploads the frame's commands and records, and the material table when materialsChanged
+    void upload(const vector<DrawElementsIndirectCommand>& commands, const vector<DrawRecord>& records,
+        const vector<MaterialRecord>& materials, bool materialsChanged)
+    {
+        if (commandBuffer == 0)
+            create();
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, recordBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, records.size() * sizeof(DrawRecord), records.data(), GL_STREAM_DRAW);
+        if (materialsChanged || !materialsUploaded) {
+            glBindBuffer(GL_TEXTURE_BUFFER, materialBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, materials.size() * sizeof(MaterialRecord), materials.data(), GL_DYNAMIC_DRAW);
+            materialsUploaded = true;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // 0, 1, 2, ... only rewritten when a frame has more draws than any before
+        if (records.size() > drawIndexCount) {
+            drawIndexCount = max(records.size(), drawIndexCount * 2);
+            vector<GLuint> indices(drawIndexCount);
+            for (GLuint i = 0; i < indices.size(); ++i)
+                indices[i] = i;
+            glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // binds the command buffer and the buffer textures for the draws after upload
+    void bind()
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glActiveTexture(GL_TEXTURE0 + DRAW_RECORDS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, recordTexture);
+        glActiveTexture(GL_TEXTURE0 + MATERIAL_TABLE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void unbind()
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // points the draw index attribute of the bound VAO at the draw index buffer
+    void enableDrawIndex()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glVertexAttribIPointer(DRAW_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(DRAW_INDEX_LOCATION, 1);
+        glEnableVertexAttribArray(DRAW_INDEX_LOCATION);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // left enabled, plain draws of the VAO would still read it
+    void disableDrawIndex()
+    {
+        glDisableVertexAttribArray(DRAW_INDEX_LOCATION);
+    }
+
+    // deletes the GL objects, call on the GL thread while the context is alive
+    void release()
+    {
+        if (commandBuffer == 0)
+            return;
+        GLuint buffers[] = {commandBuffer, recordBuffer, materialBuffer, drawIndexBuffer};
+        GLuint textures[] = {recordTexture, materialTexture};
+        glDeleteBuffers(4, buffers);
+        glDeleteTextures(2, textures);
+        commandBuffer = recordBuffer = materialBuffer = drawIndexBuffer = 0;
+        recordTexture = materialTexture = 0;
+        drawIndexCount = 0;
+        materialsUploaded = false;
+    }
+
+private:
+    GLuint commandBuffer = 0, recordBuffer = 0, materialBuffer = 0, drawIndexBuffer = 0;
+    GLuint recordTexture = 0, materialTexture = 0;
+    size_t drawIndexCount = 0;
+    size_t maxDraws = 0;
+    bool materialsUploaded = false;
+
+    void create()
+    {
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &recordBuffer);
+        glGenBuffers(1, &materialBuffer);
+        glGenBuffers(1, &drawIndexBuffer);
+        glGenTextures(1, &recordTexture);
+        glGenTextures(1, &materialTexture);
+
+        // the textures follow their buffers through every glBufferData
+        glBindTexture(GL_TEXTURE_BUFFER, recordTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, recordBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, materialBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxDraws = (size_t)max(maxTexels, 65536) / DRAW_RECORD_TEXELS;
+    }
+};
+
+#endif
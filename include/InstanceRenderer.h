@@ -0,0 +1,207 @@
+#ifndef INSTANCERENDERER_H
+#define INSTANCERENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "Shader.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Collects the copies of meshes drawn in a frame and draws each mesh (per level of detail) with a single
+// glDrawElementsInstanced. Models add themselves with Model::DrawInstanced, flush draws and empties the batches.
+// All instances of a frame go into one range of the upload ring when there is one, otherwise into a buffer of
+// its own that is orphaned and refilled by every flush.
+class InstanceRenderer
+{
+public:
+    InstanceRenderer()
+    {
+        glGenBuffers(1, &instanceBuffer);
+    }
+
+    InstanceRenderer(const InstanceRenderer&) = delete;
+    InstanceRenderer& operator =(const InstanceRenderer&) = delete;
+
+    // queues one copy of mesh, the mesh has to stay alive until flush
+    void add(Mesh& mesh, GLuint lod, const InstanceData& instance)
+    {
+        lod = min<GLuint>(lod, (GLuint)mesh.lods.size() - 1);
+        Batch& batch = batches[make_pair(&mesh, lod)];
+        batch.mesh = &mesh;
+        batch.lod = lod;
+        batch.instances.push_back(instance);
+    }
+
+    // drops the copies outside frustum in every flush from now on, set it again each frame as the camera moves
+    void setFrustum(const Frustum& frustum)
+    {
+        this->frustum = frustum;
+        this->culling = true;
+    }
+
+    // also drops the copies hidden behind the occluders of occlusion, which has to be finished before flush;
+    // nullptr turns it off. Only used together with a frustum
+    void setOcclusion(OcclusionCuller* occlusion)
+    {
+        this->occlusion = occlusion;
+    }
+
+    // streams the instances through ring from now on (between its begin and end), nullptr goes back to the own buffer
+    void setUploadRing(UploadRing* ring)
+    {
+        this->ring = ring;
+    }
+
+    // draws every queued batch with shader (which has to be in use), one draw call per batch
+    void flush(Shader& shader)
+    {
+        PROFILE_ZONE("instances");
+        culled = 0;
+        if (culling)
+            for (auto& [key, batch]: batches)
+                cull(batch);
+
+        size_t total = 0;
+        for (const auto& [key, batch]: batches)
+            total += batch.instances.size();
+
+        drawCalls = 0;
+        instances = total;
+        if (total > 0) {
+            GLuint buffer = instanceBuffer;
+            size_t base = 0;
+            UploadRange range;
+            if (ring != nullptr)
+                range = ring->allocate(total * sizeof(InstanceData));
+            if (range.data != nullptr) {
+                size_t offset = 0;
+                for (auto& [key, batch]: batches) {
+                    if (batch.instances.empty())
+                        continue;
+                    size_t size = batch.instances.size() * sizeof(InstanceData);
+                    memcpy((unsigned char*)range.data + offset, batch.instances.data(), size);
+                    batch.offset = offset;
+                    offset += size;
+                }
+                ring->flush();
+                buffer = ring->getBuffer();
+                base = (size_t)range.offset;
+            }
+            else
+                upload(total);
+
+            for (auto& [key, batch]: batches) {
+                if (batch.instances.empty())
+                    continue;
+                batch.mesh->DrawInstanced(shader, batch.lod, buffer, base + batch.offset, (GLsizei)batch.instances.size());
+                ++drawCalls;
+            }
+        }
+
+        // batches stay allocated for the next frame, the ones unused this frame are dropped (their mesh may be gone)
+        for (auto it = batches.begin(); it != batches.end();) {
+            if (it->second.instances.empty())
+                it = batches.erase(it);
+            else {
+                it->second.instances.clear();
+                ++it;
+            }
+        }
+    }
+
+    // draw calls / instances of the last flush
+    size_t getDrawCalls() const
+    {
+        return this->drawCalls;
+    }
+
+    size_t getInstances() const
+    {
+        return this->instances;
+    }
+
+    // copies frustum / occlusion culling dropped in the last flush
+    size_t getCulled() const
+    {
+        return this->culled;
+    }
+
+    // deletes the instance buffer, call on the GL thread while the context is alive
+    void release()
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBuffer = 0;
+    }
+
+private:
+    struct Batch {
+        Mesh* mesh = nullptr;
+        GLuint lod = 0;
+        vector<InstanceData> instances;
+        // where the instances are in the buffer during flush
+        size_t offset = 0;
+    };
+
+    GLuint instanceBuffer;
+    // instances the buffer has room for
+    size_t capacity = 0;
+    map<pair<const Mesh*, GLuint>, Batch> batches;
+    size_t drawCalls = 0, instances = 0, culled = 0;
+    bool culling = false;
+    Frustum frustum;
+    FrustumCuller culler;
+    OcclusionCuller* occlusion = nullptr;
+    UploadRing* ring = nullptr;
+
+    // copies the batches into the own instance buffer, without a ring or when its region is full
+    void upload(size_t total)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // grows to the largest frame so far, and orphans the old storage every frame so the upload does not
+        // wait for the GPU to finish drawing from it
+        capacity = max(capacity, total);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        size_t offset = 0;
+        for (auto& [key, batch]: batches) {
+            if (batch.instances.empty())
+                continue;
+            size_t size = batch.instances.size() * sizeof(InstanceData);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, size, batch.instances.data());
+            batch.offset = offset;
+            offset += size;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // keeps the copies of batch whose bounds intersect the frustum and are not hidden by the occluders
+    void cull(Batch& batch)
+    {
+        culler.clear();
+        for (const InstanceData& instance: batch.instances)
+            culler.add(batch.mesh->boundsMin, batch.mesh->boundsMax, instance.model);
+        const vector<uint32_t>& visible = culler.cull(frustum);
+        size_t kept = 0;
+        for (uint32_t i: visible) {
+            if (occlusion != nullptr && !occlusion->visible(batch.mesh->boundsMin, batch.mesh->boundsMax, batch.instances[i].model))
+                continue;
+            batch.instances[kept++] = batch.instances[i];
+        }
+        culled += batch.instances.size() - kept;
+        batch.instances.resize(kept);
+    }
+};
+
+#endif
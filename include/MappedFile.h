@@ -0,0 +1,175 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Read-only memory mapping of a whole file. The view stays valid while the object lives.
+class MappedFile
+{
+public:
+    MappedFile() {}
+
+    MappedFile(const string& path)
+    {
+        open(path);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator =(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            close();
+            this->ptr = other.ptr;
+            this->length = other.length;
+            this->opened = other.opened;
+#ifdef _WIN32
+            this->file = other.file;
+            this->mapping = other.mapping;
+            other.file = INVALID_HANDLE_VALUE;
+            other.mapping = NULL;
+#endif
+            other.ptr = nullptr;
+            other.length = 0;
+            other.opened = false;
+        }
+        return *this;
+    }
+
+    bool open(const string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+
+        // an empty file cannot be mapped, but it is still a valid (empty) view
+        if (length > 0) {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL) {
+                close();
+                return false;
+            }
+            ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (ptr == nullptr) {
+                close();
+                return false;
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)st.st_size;
+
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(p, length, MADV_SEQUENTIAL);
+            ptr = (const char*)p;
+        }
+        ::close(fd);
+#endif
+        opened = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (ptr != nullptr)
+            UnmapViewOfFile(ptr);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (ptr != nullptr)
+            munmap((void*)ptr, length);
+#endif
+        ptr = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool isOpen() const
+    {
+        return opened;
+    }
+
+    const char* data() const
+    {
+        return ptr;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    string_view view() const
+    {
+        return string_view(ptr, length);
+    }
+
+private:
+    const char* ptr = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+#endif
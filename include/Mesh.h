@@ -6,22 +6,28 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "GeometryArena.h"
+#include "IndirectDraw.h"
 #include "Shader.h"
+#include "VertexFormat.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
+// a coarser version of a mesh over the same vertices
+struct MeshLodData {
+    vector<GLuint> indices;
+    // how far the surface moved from the full mesh, in object space units
+    GLfloat error;
+};
 
-    bool operator ==(const Vertex& x)
-    {
-        return (Position == x.Position && Normal == x.Normal);
-    }
+// a level of detail inside the index buffer of a Mesh, level 0 is the full mesh
+struct MeshLod {
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLfloat error;
 };
 
 struct Material {
@@ -37,61 +43,236 @@ public:
     vector<Vertex> vertices;
     vector<GLuint> indices;
     Material material;
+    // the VAO of the arena holding the mesh, shared by every mesh of its layout and index type
     GLuint VAO;
+    // indices in the index buffer, which holds every level of detail one after another
+    GLuint indexCount;
+    vector<MeshLod> lods;
+    // object space bounding box, and a bounding sphere around its centre
+    glm::vec3 boundsMin, boundsMax;
+    glm::vec3 sphereCentre;
+    GLfloat sphereRadius;
+    // format of the GPU copy, the CPU side vertices are full precision (decoded from it for packed cache data)
+    VertexLayout layout;
+    GLenum indexType;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<GLuint> indices, Material material)
+    Mesh(vector<Vertex> vertices, vector<GLuint> indices, Material material, VertexLayout layout = VERTEX_FLOAT, const vector<MeshLodData>& lodData = vector<MeshLodData>())
     {
-        this->vertices = vertices;
-        this->indices = indices;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
         this->material = material;
+        computeBounds(this->vertices.data(), this->vertices.size(), boundsMin, boundsMax);
+        computeSphere(this->vertices.data(), this->vertices.size(), boundsMin, boundsMax, sphereCentre, sphereRadius);
+
+        lods.push_back(MeshLod{0, (GLuint)this->indices.size(), 0.0f});
+        for (const MeshLodData& lod: lodData)
+            lods.push_back(MeshLod{lods.back().firstIndex + lods.back().indexCount, (GLuint)lod.indices.size(), lod.error});
+
+        // the buffer contents when the GPU copy differs from the CPU one
+        const GLuint* indexData = this->indices.data();
+        vector<GLuint> allIndices;
+        if (!lodData.empty()) {
+            allIndices = this->indices;
+            for (const MeshLodData& lod: lodData)
+                allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+            indexData = allIndices.data();
+        }
+        size_t indexTotal = lods.back().firstIndex + lods.back().indexCount;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (layout == VERTEX_PACKED) {
+            vector<PackedVertex> packed = packVertices(this->vertices.data(), this->vertices.size(), boundsMin, boundsMax);
+            if (::indexType(layout, packed.size()) == GL_UNSIGNED_SHORT) {
+                vector<GLushort> packedIndices = packIndices(indexData, indexTotal);
+                setupMesh(packed.data(), packed.size(), packedIndices.data(), indexTotal, layout);
+            }
+            else
+                setupMesh(packed.data(), packed.size(), indexData, indexTotal, layout);
+        }
+        else
+            setupMesh(this->vertices.data(), this->vertices.size(), indexData, indexTotal, layout);
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // uploads external (e.g. memory-mapped) data already in the given layout straight to the GPU,
+    // no CPU side copy is kept (see decodeCopy). The index type follows from indexType(layout, vertexCount).
+    Mesh(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, VertexLayout layout, Material material, glm::vec3 boundsMin, glm::vec3 boundsMax, vector<MeshLod> lods)
     {
-        // Пока используем только material.Diffuse
-        shader.setVec3("material.ambient", material.Diffuse);
-        shader.setVec3("material.diffuse", material.Diffuse);
-        shader.setVec3("material.specular", material.Diffuse);
-        shader.setFloat("material.shininess", material.Shininess);
+        this->material = material;
+        this->boundsMin = boundsMin;
+        this->boundsMax = boundsMax;
+        // without the vertices the sphere is the one through the corners of the box
+        this->sphereCentre = (boundsMin + boundsMax) * 0.5f;
+        this->sphereRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+        this->lods = std::move(lods);
+        setupMesh(vertices, vertexCount, indices, indexCount, layout);
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    // fills the CPU copy (the vertices and the level 0 indices) of a mesh built from external data, from the same
+    // data, for meshes that are drawn as occluders. Quantized when the layout is packed
+    void decodeCopy(const void* vertices, size_t vertexCount, const void* indices)
+    {
+        this->vertices = unpackVertices(vertices, vertexCount, layout, boundsMin, boundsMax);
+        this->indices = unpackIndices(indices, lods[0].indexCount, indexType);
+    }
+
+    static void computeBounds(const Vertex* vertices, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        boundsMin = count > 0 ? vertices[0].Position : glm::vec3(0.0f);
+        boundsMax = boundsMin;
+        for (size_t i = 1; i < count; ++i) {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+    }
+
+    // the sphere around the centre of the box through the farthest vertex, at most as large as the one through the corners
+    static void computeSphere(const Vertex* vertices, size_t count, glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3& centre, GLfloat& radius)
+    {
+        centre = (boundsMin + boundsMax) * 0.5f;
+        GLfloat squared = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec3 offset = vertices[i].Position - centre;
+            squared = max(squared, glm::dot(offset, offset));
+        }
+        radius = sqrt(squared);
+    }
+
+    // render the mesh, lod picks a level of detail (clamped to the coarsest one)
+    void Draw(Shader& shader, GLuint lod = 0)
+    {
+        applyMaterial(shader);
+        bind(shader);
+        drawElements(lod);
         glBindVertexArray(0);
     }
 
-private:
-    // render data 
-    GLuint VBO, EBO;
+    // renders count copies of the mesh in one draw call, their InstanceData starts at offset bytes into instanceBuffer
+    void DrawInstanced(Shader& shader, GLuint lod, GLuint instanceBuffer, size_t offset, GLsizei count)
+    {
+        applyMaterial(shader);
+        bind(shader, true);
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+        const MeshLod& level = lods[min<size_t>(lod, lods.size() - 1)];
+        const VertexFormat& format = instanceFormat();
+        // the pointers are set per draw, since the batches of a frame share one buffer at different offsets
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (const VertexAttribute& attribute: format.attributes) {
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, format.stride, (void*)(offset + attribute.offset));
+            glEnableVertexAttribArray(attribute.location);
+        }
+        const GeometryArena::Allocation& range = arena->allocation(allocation);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexOffset(range, level), count, range.vertexOffset);
+        // left enabled, they would be read from the wrong buffer by the next plain Draw
+        for (const VertexAttribute& attribute: format.attributes)
+            glDisableVertexAttribArray(attribute.location);
+        glBindVertexArray(0);
+    }
+
+    // The steps of Draw, for callers that skip the ones whose state is already set (see RenderQueue).
+    // applyMaterial sets the material uniforms, bind the per-mesh uniforms and the VAO (bindUniforms and
+    // bindVertexArray on their own), drawElements draws a level of detail with the VAO bound.
+    void applyMaterial(Shader& shader)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        const MeshUniforms& uniforms = shader.meshUniforms();
+        MaterialRecord record = materialRecord();
+        shader.setVec3(uniforms.ambient, glm::vec3(record.ambient));
+        shader.setVec3(uniforms.diffuse, glm::vec3(record.diffuse));
+        shader.setVec3(uniforms.specular, glm::vec3(record.specular));
+        shader.setFloat(uniforms.shininess, record.ambient.w);
+    }
+
+    // the material values the shader sees, as uniforms (applyMaterial) or in the material table of indirect draws
+    MaterialRecord materialRecord() const
+    {
+        // Пока используем только material.Diffuse
+        return MaterialRecord{glm::vec4(material.Diffuse, material.Shininess), glm::vec4(material.Diffuse, 0.0f), glm::vec4(material.Diffuse, 0.0f)};
+    }
 
+    // decodes quantized positions against the bounds, identity for float ones
+    glm::vec3 positionScale() const
+    {
+        return layout == VERTEX_PACKED ? boundsMax - boundsMin : glm::vec3(1.0f);
+    }
+
+    glm::vec3 positionOffset() const
+    {
+        return layout == VERTEX_PACKED ? boundsMin : glm::vec3(0.0f);
+    }
+
+    // the draw of a level of detail as an indirect command, baseInstance is left to the caller
+    DrawElementsIndirectCommand indirectCommand(GLuint lod) const
+    {
+        const MeshLod& level = lods[min<size_t>(lod, lods.size() - 1)];
+        const GeometryArena::Allocation& range = arena->allocation(allocation);
+        return DrawElementsIndirectCommand{level.indexCount, 1, range.indexOffset + level.firstIndex, (GLint)range.vertexOffset, 0};
+    }
+
+    void bind(Shader& shader, bool instanced = false)
+    {
+        bindUniforms(shader, instanced);
+        bindVertexArray();
+    }
+
+    void bindUniforms(Shader& shader, bool instanced = false)
+    {
+        const MeshUniforms& uniforms = shader.meshUniforms();
+        shader.setVec3(uniforms.positionScale, positionScale());
+        shader.setVec3(uniforms.positionOffset, positionOffset());
+
+        // instanced draws take the transform from the instance attributes instead of the model uniforms
+        shader.setFloat(uniforms.instanced, instanced ? 1.0f : 0.0f);
+        // only RenderQueue's multi-draw-indirect path turns it on
+        shader.setFloat(uniforms.indirect, 0.0f);
+    }
+
+    void bindVertexArray()
+    {
+        // a compaction may have replaced the arena buffers, the VAO itself stays
         glBindVertexArray(VAO);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    }
+
+    void drawElements(GLuint lod)
+    {
+        const MeshLod& level = lods[min<size_t>(lod, lods.size() - 1)];
+        // the allocation is looked up per draw, since the arena moves it when it grows or compacts
+        const GeometryArena::Allocation& range = arena->allocation(allocation);
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexOffset(range, level), range.vertexOffset);
+    }
+
+    // gives the vertices and indices back to the arena, the mesh cannot be drawn afterwards
+    void release()
+    {
+        if (arena != nullptr)
+            arena->free(allocation);
+        arena = nullptr;
+        VAO = 0;
+        indexCount = 0;
+        lods.assign(1, MeshLod{0, 0, 0.0f});
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+private:
+    // render data
+    GeometryArena* arena = nullptr;
+    GLuint allocation = 0;
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)0);
-        glEnableVertexAttribArray(0);
+    void* indexOffset(const GeometryArena::Allocation& range, const MeshLod& level) const
+    {
+        return (void*)((size_t)(range.indexOffset + level.firstIndex) * indexSize(indexType));
+    }
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
+    // copies the vertices and indices into the arena of the layout and index type
+    void setupMesh(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, VertexLayout layout)
+    {
+        this->layout = layout;
+        this->indexType = ::indexType(layout, vertexCount);
+        this->indexCount = (GLuint)indexCount;
+        if (lods.empty())
+            lods.push_back(MeshLod{0, (GLuint)indexCount, 0.0f});
 
-        glBindVertexArray(0);
+        arena = &geometryArena(layout, indexType);
+        allocation = arena->allocate(vertices, vertexCount, indices, indexCount);
+        VAO = arena->getVAO();
     }
 };
 #endif
\ No newline at end of file
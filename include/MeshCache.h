@@ -0,0 +1,471 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Binary mesh cache: the welded result of loading an OBJ file with its MTL libraries, stored so later
+// loads can memory-map it and hand the vertex/index blobs straight to glBufferData. The blobs are
+// already in the layout the GPU gets (float or packed vertices, 32 or 16-bit indices).
+//
+// Layout (native endianness, blobs aligned to MESH_CACHE_ALIGNMENT):
+//     MeshCacheHeader
+//     MeshCacheSource[sourceCount]      the OBJ and MTL files with the size and mtime they had
+//     MeshCacheMaterial[materialCount]
+//     MeshCacheMesh[meshCount]
+//     MeshCacheLod[lodCount]            the levels of detail of all meshes, level 0 first
+//     string table
+//     vertex and index blobs
+const uint32_t MESH_CACHE_MAGIC = 0x4D474E4E; // "NNGM"
+const uint32_t MESH_CACHE_VERSION = 4;
+const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+// MeshCacheHeader::flags, the load options that change the stored meshes
+const uint32_t MESH_CACHE_OPTIMIZED = 1;
+// the blobs hold PackedVertex and, where indexType() says so, 16-bit indices
+const uint32_t MESH_CACHE_COMPRESSED = 2;
+// bits 8-11 hold ObjLoadOptions::lodLevels
+const uint32_t MESH_CACHE_LOD_SHIFT = 8;
+
+// a string in the string table
+struct MeshCacheString {
+    uint32_t offset, length;
+};
+
+struct MeshCacheHeader {
+    uint32_t magic, version;
+    uint32_t sourceCount, materialCount, meshCount;
+    // ObjLoadOptions::weldEpsilon the meshes were welded with
+    GLfloat weldEpsilon;
+    uint32_t flags, lodCount;
+    uint64_t stringOffset, stringSize;
+};
+
+struct MeshCacheSource {
+    MeshCacheString path;
+    uint64_t size;
+    int64_t modified;
+};
+
+struct MeshCacheMaterial {
+    MeshCacheString name;
+    GLfloat ambient[3], diffuse[3], specular[3];
+    GLfloat shininess;
+};
+
+struct MeshCacheMesh {
+    uint64_t vertexOffset, indexOffset;
+    // indexCount covers every level of detail
+    uint32_t vertexCount, indexCount;
+    // index into the material table, range in the level of detail table
+    uint32_t material, firstLod, lodCount, reserved;
+    GLfloat boundsMin[3], boundsMax[3];
+};
+
+struct MeshCacheLod {
+    uint32_t firstIndex, indexCount;
+    GLfloat error;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Vertex) == 6 * sizeof(GLfloat), "the cache stores Vertex as it lies in memory");
+static_assert(sizeof(PackedVertex) == 12, "the cache stores PackedVertex as it lies in memory");
+
+inline VertexLayout meshCacheLayout(uint32_t flags)
+{
+    return flags & MESH_CACHE_COMPRESSED ? VERTEX_PACKED : VERTEX_FLOAT;
+}
+
+inline uint32_t meshCacheFlags(const ObjLoadOptions& options)
+{
+    return (options.optimizeMeshes ? MESH_CACHE_OPTIMIZED : 0) | (options.compressVertices ? MESH_CACHE_COMPRESSED : 0)
+        | (min<uint32_t>(options.lodLevels, 15) << MESH_CACHE_LOD_SHIFT);
+}
+
+// the cache of path loaded with options, named after the flags and weld epsilon so loads with different
+// options keep their own caches instead of rewriting one file in turn (e.g. path.obj.00000301-3a83126f.meshcache)
+inline string meshCachePath(const string& path, const ObjLoadOptions& options)
+{
+    uint32_t weld;
+    memcpy(&weld, &options.weldEpsilon, sizeof(weld));
+    char key[32];
+    snprintf(key, sizeof(key), ".%08x-%08x", meshCacheFlags(options), weld);
+    return path + key + ".meshcache";
+}
+
+// a temporary path next to cachePath that no other writer (thread or process) uses at the same time
+inline string meshCacheTempPath(const string& cachePath)
+{
+    static atomic<uint32_t> writers(0);
+    size_t thread = hash<thread::id>()(this_thread::get_id());
+    uint64_t time = (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+    return cachePath + ".tmp." + to_string(thread ^ time) + "-" + to_string(writers++);
+}
+
+inline MeshCacheMaterial encodeMaterial(const Material& material, MeshCacheString name)
+{
+    MeshCacheMaterial m;
+    m.name = name;
+    memcpy(m.ambient, &material.Ambient[0], sizeof(m.ambient));
+    memcpy(m.diffuse, &material.Diffuse[0], sizeof(m.diffuse));
+    memcpy(m.specular, &material.Specular[0], sizeof(m.specular));
+    m.shininess = material.Shininess;
+    return m;
+}
+
+inline Material decodeMaterial(const MeshCacheMaterial& m)
+{
+    Material material;
+    material.Ambient = glm::vec3(m.ambient[0], m.ambient[1], m.ambient[2]);
+    material.Diffuse = glm::vec3(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+    material.Specular = glm::vec3(m.specular[0], m.specular[1], m.specular[2]);
+    material.Shininess = m.shininess;
+    return material;
+}
+
+// the levels of detail of a mesh, lodTable is the table its firstLod points into
+inline vector<MeshLod> decodeLods(const MeshCacheMesh& mesh, const MeshCacheLod* lodTable)
+{
+    vector<MeshLod> lods;
+    for (uint32_t l = 0; l < mesh.lodCount; ++l) {
+        const MeshCacheLod& lod = lodTable[mesh.firstLod + l];
+        lods.push_back(MeshLod{lod.firstIndex, lod.indexCount, lod.error});
+    }
+    return lods;
+}
+
+// size and modification time of a file, false when it cannot be read
+inline bool fileStamp(const string& path, uint64_t& size, int64_t& modified)
+{
+    error_code error;
+    size = (uint64_t)filesystem::file_size(path, error);
+    if (error)
+        return false;
+    modified = (int64_t)filesystem::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+// writes the cache of the model loaded from sourcePath, returns false (and leaves no file) on failure
+inline bool writeMeshCache(const string& cachePath, const string& sourcePath, const ModelData& data, const ObjLoadOptions& options)
+{
+    string strings;
+    auto addString = [&](const string& text) {
+        MeshCacheString s{(uint32_t)strings.size(), (uint32_t)text.size()};
+        strings += text;
+        return s;
+    };
+    auto align = [](uint64_t offset) {
+        return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+    };
+
+    vector<MeshCacheSource> sources;
+    vector<string> paths = {sourcePath};
+    paths.insert(paths.end(), data.libraries.begin(), data.libraries.end());
+    for (const string& path: paths) {
+        MeshCacheSource source;
+        if (!fileStamp(path, source.size, source.modified))
+            return false;
+        source.path = addString(path);
+        sources.push_back(source);
+    }
+
+    // meshes may name materials no library defines, Model gives those a zero material
+    map<string, Material> materials = data.materials;
+    for (const MeshData& mesh: data.meshes)
+        materials.emplace(mesh.material, Material{});
+
+    vector<MeshCacheMaterial> materialTable;
+    map<string, uint32_t> materialIds;
+    for (const auto& [name, material]: materials) {
+        materialIds[name] = (uint32_t)materialTable.size();
+        materialTable.push_back(encodeMaterial(material, addString(name)));
+    }
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceCount = (uint32_t)sources.size();
+    header.materialCount = (uint32_t)materialTable.size();
+    header.meshCount = (uint32_t)data.meshes.size();
+    header.weldEpsilon = options.weldEpsilon;
+    header.flags = meshCacheFlags(options);
+    for (const MeshData& mesh: data.meshes)
+        header.lodCount += 1 + (uint32_t)mesh.lods.size();
+    header.stringOffset = sizeof(MeshCacheHeader) + sources.size() * sizeof(MeshCacheSource)
+        + materialTable.size() * sizeof(MeshCacheMaterial) + data.meshes.size() * sizeof(MeshCacheMesh)
+        + header.lodCount * sizeof(MeshCacheLod);
+    header.stringSize = strings.size();
+
+    VertexLayout layout = meshCacheLayout(header.flags);
+    GLsizei stride = vertexFormat(layout).stride;
+
+    vector<MeshCacheMesh> meshTable;
+    vector<MeshCacheLod> lodTable;
+    vector<vector<GLuint>> indexBlobs;
+    uint64_t offset = align(header.stringOffset + header.stringSize);
+    for (const MeshData& mesh: data.meshes) {
+        MeshCacheMesh m = {};
+        m.firstLod = (uint32_t)lodTable.size();
+        m.lodCount = 1 + (uint32_t)mesh.lods.size();
+        lodTable.push_back(MeshCacheLod{0, (uint32_t)mesh.indices.size(), 0.0f, 0});
+        for (const MeshLodData& lod: mesh.lods)
+            lodTable.push_back(MeshCacheLod{lodTable.back().firstIndex + lodTable.back().indexCount, (uint32_t)lod.indices.size(), lod.error, 0});
+
+        indexBlobs.emplace_back(mesh.indices);
+        for (const MeshLodData& lod: mesh.lods)
+            indexBlobs.back().insert(indexBlobs.back().end(), lod.indices.begin(), lod.indices.end());
+
+        m.vertexCount = (uint32_t)mesh.vertices.size();
+        m.indexCount = (uint32_t)indexBlobs.back().size();
+        m.material = materialIds[mesh.material];
+        m.vertexOffset = offset;
+        offset = align(offset + mesh.vertices.size() * stride);
+        m.indexOffset = offset;
+        offset = align(offset + m.indexCount * indexSize(indexType(layout, mesh.vertices.size())));
+
+        glm::vec3 boundsMin, boundsMax;
+        Mesh::computeBounds(mesh.vertices.data(), mesh.vertices.size(), boundsMin, boundsMax);
+        memcpy(m.boundsMin, &boundsMin[0], sizeof(m.boundsMin));
+        memcpy(m.boundsMax, &boundsMax[0], sizeof(m.boundsMax));
+        meshTable.push_back(m);
+    }
+
+    // written next to the cache and renamed, so a reader never maps a half written file
+    string tempPath = meshCacheTempPath(cachePath);
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out.is_open())
+            return false;
+
+        uint64_t written = 0;
+        auto write = [&](const void* bytes, uint64_t size) {
+            out.write((const char*)bytes, size);
+            written += size;
+        };
+        auto pad = [&]() {
+            static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+            write(zeros, align(written) - written);
+        };
+
+        write(&header, sizeof(header));
+        write(sources.data(), sources.size() * sizeof(MeshCacheSource));
+        write(materialTable.data(), materialTable.size() * sizeof(MeshCacheMaterial));
+        write(meshTable.data(), meshTable.size() * sizeof(MeshCacheMesh));
+        write(lodTable.data(), lodTable.size() * sizeof(MeshCacheLod));
+        write(strings.data(), strings.size());
+        for (size_t i = 0; i < data.meshes.size(); ++i) {
+            const MeshData& mesh = data.meshes[i];
+            pad();
+            if (layout == VERTEX_PACKED) {
+                glm::vec3 boundsMin(meshTable[i].boundsMin[0], meshTable[i].boundsMin[1], meshTable[i].boundsMin[2]);
+                glm::vec3 boundsMax(meshTable[i].boundsMax[0], meshTable[i].boundsMax[1], meshTable[i].boundsMax[2]);
+                vector<PackedVertex> packed = packVertices(mesh.vertices.data(), mesh.vertices.size(), boundsMin, boundsMax);
+                write(packed.data(), packed.size() * sizeof(PackedVertex));
+            }
+            else
+                write(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            pad();
+            const vector<GLuint>& indices = indexBlobs[i];
+            if (indexType(layout, mesh.vertices.size()) == GL_UNSIGNED_SHORT) {
+                vector<GLushort> packed = packIndices(indices.data(), indices.size());
+                write(packed.data(), packed.size() * sizeof(GLushort));
+            }
+            else
+                write(indices.data(), indices.size() * sizeof(GLuint));
+        }
+        pad();
+
+        if (!out.good()) {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    error_code error;
+    filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// A memory-mapped mesh cache. The vertex/index pointers stay valid while the object lives.
+class MeshCache
+{
+public:
+    // maps cachePath and checks it is an intact cache of sourcePath built from the current sources with the same options
+    bool open(const string& cachePath, const string& sourcePath, const ObjLoadOptions& options)
+    {
+        if (!file.open(cachePath) || !validate(sourcePath, options)) {
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    size_t meshCount() const
+    {
+        return header()->meshCount;
+    }
+
+    const MeshCacheMesh& mesh(size_t i) const
+    {
+        return meshes()[i];
+    }
+
+    VertexLayout layout() const
+    {
+        return meshCacheLayout(header()->flags);
+    }
+
+    // the vertex blob of mesh i, Vertex or PackedVertex depending on layout()
+    const void* vertices(size_t i) const
+    {
+        return file.data() + mesh(i).vertexOffset;
+    }
+
+    // the index blob of mesh i, of type indexType(layout(), vertex count)
+    const void* indices(size_t i) const
+    {
+        return file.data() + mesh(i).indexOffset;
+    }
+
+    // the levels of detail of mesh i, level 0 is the full mesh
+    vector<MeshLod> lods(size_t i) const
+    {
+        return decodeLods(mesh(i), lodTable());
+    }
+
+    size_t materialCount() const
+    {
+        return header()->materialCount;
+    }
+
+    string_view materialName(size_t i) const
+    {
+        return text(materials()[i].name);
+    }
+
+    Material material(size_t i) const
+    {
+        return decodeMaterial(materials()[i]);
+    }
+
+private:
+    MappedFile file;
+
+    const MeshCacheHeader* header() const
+    {
+        return (const MeshCacheHeader*)file.data();
+    }
+
+    const MeshCacheSource* sources() const
+    {
+        return (const MeshCacheSource*)(file.data() + sizeof(MeshCacheHeader));
+    }
+
+    const MeshCacheMaterial* materials() const
+    {
+        return (const MeshCacheMaterial*)(sources() + header()->sourceCount);
+    }
+
+    const MeshCacheMesh* meshes() const
+    {
+        return (const MeshCacheMesh*)(materials() + header()->materialCount);
+    }
+
+    const MeshCacheLod* lodTable() const
+    {
+        return (const MeshCacheLod*)(meshes() + header()->meshCount);
+    }
+
+    string_view text(MeshCacheString s) const
+    {
+        return string_view(file.data() + header()->stringOffset + s.offset, s.length);
+    }
+
+    bool inFile(uint64_t offset, uint64_t size) const
+    {
+        return offset <= file.size() && size <= file.size() - offset;
+    }
+
+    bool validate(const string& sourcePath, const ObjLoadOptions& options) const
+    {
+        if (!inFile(0, sizeof(MeshCacheHeader)))
+            return false;
+        const MeshCacheHeader& h = *header();
+        if (h.magic != MESH_CACHE_MAGIC || h.version != MESH_CACHE_VERSION || h.weldEpsilon != options.weldEpsilon || h.flags != meshCacheFlags(options) || h.sourceCount == 0)
+            return false;
+
+        uint64_t tables = (uint64_t)h.sourceCount * sizeof(MeshCacheSource) + (uint64_t)h.materialCount * sizeof(MeshCacheMaterial)
+            + (uint64_t)h.meshCount * sizeof(MeshCacheMesh) + (uint64_t)h.lodCount * sizeof(MeshCacheLod);
+        if (h.stringOffset != sizeof(MeshCacheHeader) + tables || !inFile(h.stringOffset, h.stringSize))
+            return false;
+
+        auto validString = [&](MeshCacheString s) {
+            return (uint64_t)s.offset + s.length <= h.stringSize;
+        };
+
+        for (uint32_t i = 0; i < h.sourceCount; ++i) {
+            const MeshCacheSource& source = sources()[i];
+            if (!validString(source.path))
+                return false;
+            string path(text(source.path));
+            if (i == 0 && path != sourcePath)
+                return false;
+            uint64_t size;
+            int64_t modified;
+            if (!fileStamp(path, size, modified) || size != source.size || modified != source.modified)
+                return false;
+        }
+
+        for (uint32_t i = 0; i < h.materialCount; ++i)
+            if (!validString(materials()[i].name))
+                return false;
+
+        for (uint32_t i = 0; i < h.meshCount; ++i) {
+            const MeshCacheMesh& m = meshes()[i];
+            if (m.lodCount == 0 || (uint64_t)m.firstLod + m.lodCount > h.lodCount)
+                return false;
+            for (uint32_t l = 0; l < m.lodCount; ++l) {
+                const MeshCacheLod& lod = lodTable()[m.firstLod + l];
+                if ((uint64_t)lod.firstIndex + lod.indexCount > m.indexCount)
+                    return false;
+            }
+            if (m.material >= h.materialCount || m.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || m.indexOffset % MESH_CACHE_ALIGNMENT != 0)
+                return false;
+            VertexLayout layout = meshCacheLayout(h.flags);
+            uint64_t vertexBytes = (uint64_t)m.vertexCount * vertexFormat(layout).stride;
+            uint64_t indexBytes = (uint64_t)m.indexCount * indexSize(indexType(layout, m.vertexCount));
+            if (!inFile(m.vertexOffset, vertexBytes) || !inFile(m.indexOffset, indexBytes))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// Post-transform vertex cache efficiency of an index list:
+// ACMR = vertex shader runs per triangle (0.5 is ideal for a big regular grid, 3 is no reuse at all),
+// ATVR = vertex shader runs per vertex (1 is ideal).
+struct VertexCacheStats {
+    GLfloat acmr = 0.0f;
+    GLfloat atvr = 0.0f;
+};
+
+struct MeshOptimizationReport {
+    VertexCacheStats before, after;
+};
+
+// simulates a FIFO post-transform cache of cacheSize entries, which is how most GPUs behave
+inline VertexCacheStats analyzeVertexCache(const vector<GLuint>& indices, size_t vertexCount, GLuint cacheSize = 16)
+{
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    vector<size_t> loadedAt(vertexCount, 0);
+    vector<bool> seen(vertexCount, false);
+    size_t misses = 0;
+    for (GLuint index: indices) {
+        if (seen[index] && misses - loadedAt[index] < cacheSize)
+            continue;
+        seen[index] = true;
+        loadedAt[index] = misses++;
+    }
+
+    stats.acmr = (GLfloat)misses / (GLfloat)(indices.size() / 3);
+    stats.atvr = (GLfloat)misses / (GLfloat)vertexCount;
+    return stats;
+}
+
+// Reorders the triangles of indices for post-transform cache locality (Tom Forsyth, "Linear-Speed
+// Vertex Cache Optimisation"). Greedily emits the triangle with the best score, a vertex scores high
+// when it is near the top of a simulated LRU cache and when few triangles still use it.
+inline void optimizeVertexCache(vector<GLuint>& indices, size_t vertexCount)
+{
+    const GLint CACHE_SIZE = 32;
+    const GLfloat DECAY_POWER = 1.5f;
+    const GLfloat LAST_TRIANGLE_SCORE = 0.75f;
+    const GLfloat VALENCE_BOOST_SCALE = 2.0f;
+    const GLfloat VALENCE_BOOST_POWER = 0.5f;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return;
+
+    // cache position scores and valence boosts are looked up instead of calling pow per vertex update
+    GLfloat cacheScore[CACHE_SIZE];
+    for (GLint i = 0; i < CACHE_SIZE; ++i)
+        cacheScore[i] = i < 3 ? LAST_TRIANGLE_SCORE : pow(1.0f - (GLfloat)(i - 3) / (CACHE_SIZE - 3), DECAY_POWER);
+    const GLuint VALENCE_TABLE_SIZE = 64;
+    GLfloat valenceScore[VALENCE_TABLE_SIZE];
+    for (GLuint i = 1; i < VALENCE_TABLE_SIZE; ++i)
+        valenceScore[i] = VALENCE_BOOST_SCALE * pow((GLfloat)i, -VALENCE_BOOST_POWER);
+
+    auto vertexScore = [&](GLint cachePosition, GLuint remaining) {
+        if (remaining == 0)
+            return -1.0f;
+        GLfloat score = cachePosition >= 0 ? cacheScore[cachePosition] : 0.0f;
+        return score + (remaining < VALENCE_TABLE_SIZE ? valenceScore[remaining] : VALENCE_BOOST_SCALE * pow((GLfloat)remaining, -VALENCE_BOOST_POWER));
+    };
+
+    // triangles using each vertex, the first remaining[v] entries of a vertex are the ones not emitted yet
+    vector<GLuint> remaining(vertexCount, 0);
+    for (GLuint index: indices)
+        ++remaining[index];
+    vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    vector<GLuint> adjacency(indices.size());
+    {
+        vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+    }
+
+    vector<GLint> cachePosition(vertexCount, -1);
+    vector<GLfloat> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    vector<GLfloat> triangleScore(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+    size_t best = max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+    size_t cursor = 0;
+
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    vector<GLuint> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        // no cached vertex has a triangle left, continue with the next unused one in the input
+        if (best == triangleCount) {
+            while (emitted[cursor])
+                ++cursor;
+            best = cursor;
+        }
+
+        const GLuint* triangle = &indices[3 * best];
+        emitted[best] = true;
+        nextCache.assign(triangle, triangle + 3);
+        for (GLuint i = 0; i < 3; ++i) {
+            GLuint v = triangle[i];
+            result.push_back(v);
+
+            // drop the triangle from the remaining list of its vertices
+            size_t begin = adjacencyOffset[v];
+            size_t end = begin + remaining[v];
+            for (size_t j = begin; j < end; ++j)
+                if (adjacency[j] == best) {
+                    swap(adjacency[j], adjacency[end - 1]);
+                    break;
+                }
+            --remaining[v];
+        }
+
+        for (GLuint v: cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                nextCache.push_back(v);
+        swap(cache, nextCache);
+
+        // rescore the cached vertices (and the ones pushed out) and their triangles
+        for (size_t i = 0; i < cache.size(); ++i) {
+            GLuint v = cache[i];
+            cachePosition[v] = i < (size_t)CACHE_SIZE ? (GLint)i : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        best = triangleCount;
+        GLfloat bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); ++i) {
+            GLuint v = cache[i];
+            for (size_t j = adjacencyOffset[v]; j < adjacencyOffset[v] + remaining[v]; ++j) {
+                GLuint t = adjacency[j];
+                GLfloat s = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                triangleScore[t] = s;
+                if (s > bestScore) {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+
+        if (cache.size() > (size_t)CACHE_SIZE)
+            cache.resize(CACHE_SIZE);
+    }
+
+    indices = std::move(result);
+}
+
+// Renumbers the vertices in order of first use, so the vertex fetch walks memory linearly.
+// Vertices no index uses are dropped.
+inline void optimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    const GLuint UNUSED = 0xFFFFFFFFu;
+    vector<GLuint> remap(vertices.size(), UNUSED);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (GLuint& index: indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = (GLuint)reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(reordered);
+}
+
+// runs both passes on one mesh and measures the cache efficiency around them
+inline MeshOptimizationReport optimizeMesh(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    MeshOptimizationReport report;
+    report.before = analyzeVertexCache(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    optimizeVertexFetch(vertices, indices);
+    report.after = analyzeVertexCache(indices, vertices.size());
+    return report;
+}
+
+#endif
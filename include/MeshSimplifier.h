@@ -0,0 +1,328 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+using namespace std;
+
+// A symmetric 4x4 error quadric (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"),
+// the weighted sum of squared distances to a set of planes, with the sum of the weights.
+struct Quadric {
+    double a[10] = {};
+    double weight = 0.0;
+
+    static Quadric plane(glm::dvec3 n, double d, double weight)
+    {
+        Quadric q;
+        q.a[0] = n.x * n.x * weight; q.a[1] = n.x * n.y * weight; q.a[2] = n.x * n.z * weight; q.a[3] = n.x * d * weight;
+        q.a[4] = n.y * n.y * weight; q.a[5] = n.y * n.z * weight; q.a[6] = n.y * d * weight;
+        q.a[7] = n.z * n.z * weight; q.a[8] = n.z * d * weight;
+        q.a[9] = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    Quadric& operator +=(const Quadric& other)
+    {
+        for (GLuint i = 0; i < 10; ++i)
+            a[i] += other.a[i];
+        weight += other.weight;
+        return *this;
+    }
+
+    double error(glm::dvec3 p) const
+    {
+        double e = a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x
+                 + a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y
+                 + a[7] * p.z * p.z + 2.0 * a[8] * p.z
+                 + a[9];
+        return max(e, 0.0);
+    }
+
+    // the weighted mean of the squared distances, a squared distance in object space whatever the weights
+    double meanError(glm::dvec3 p) const
+    {
+        return weight > 0.0 ? error(p) / weight : 0.0;
+    }
+};
+
+struct SimplifiedMesh {
+    vector<GLuint> indices;
+    // the largest root mean squared distance of a kept vertex to the planes it replaced, in object space units
+    GLfloat error = 0.0f;
+};
+
+// Reduces indices to about targetTriangles triangles by collapsing edges in order of quadric error,
+// stopping early when the next collapse would move the surface by more than maxError.
+// Collapses keep one of the edge ends, so the result indexes the same vertices.
+// Vertices sharing a position (split by normals) move together; a corner moved to a new position takes
+// the vertex there whose normal is closest to its own. Open borders are held in place by extra planes.
+inline SimplifiedMesh simplifyMesh(const vector<Vertex>& vertices, const vector<GLuint>& indices, size_t targetTriangles, GLfloat maxError)
+{
+    const double BORDER_WEIGHT = 10.0;
+    // a collapse may not turn a triangle further than this (cosine of the angle)
+    const double MIN_NORMAL_COSINE = 0.2;
+
+    SimplifiedMesh result;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount <= targetTriangles || vertices.empty()) {
+        result.indices = indices;
+        return result;
+    }
+
+    // 1. number the distinct positions
+    vector<GLuint> order(vertices.size());
+    for (GLuint i = 0; i < order.size(); ++i)
+        order[i] = i;
+    auto less = [&](GLuint x, GLuint y) {
+        const glm::vec3& a = vertices[x].Position;
+        const glm::vec3& b = vertices[y].Position;
+        return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+    };
+    sort(order.begin(), order.end(), less);
+
+    vector<GLuint> positionOf(vertices.size());
+    vector<glm::dvec3> position;
+    vector<vector<GLuint>> verticesAt;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i == 0 || less(order[i - 1], order[i])) {
+            position.push_back(glm::dvec3(vertices[order[i]].Position));
+            verticesAt.emplace_back();
+        }
+        positionOf[order[i]] = (GLuint)(position.size() - 1);
+        verticesAt.back().push_back(order[i]);
+    }
+    size_t positionCount = position.size();
+
+    // 2. triangles over positions, with their adjacency
+    vector<GLuint> corner(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        corner[i] = positionOf[indices[i]];
+
+    vector<bool> alive(triangleCount, true);
+    size_t aliveCount = triangleCount;
+    vector<vector<GLuint>> trianglesAt(positionCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        GLuint* c = &corner[3 * t];
+        if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2]) {
+            alive[t] = false;
+            --aliveCount;
+            continue;
+        }
+        for (GLuint k = 0; k < 3; ++k)
+            trianglesAt[c[k]].push_back((GLuint)t);
+    }
+
+    auto triangleNormal = [&](GLuint a, GLuint b, GLuint c) {
+        return glm::cross(position[b] - position[a], position[c] - position[a]);
+    };
+
+    // 3. quadrics: the planes of the adjacent triangles, weighted by area, and planes along open borders weighted by
+    // their squared length, so every weight is an area and the mean error scales with the square of the mesh
+    vector<Quadric> quadric(positionCount);
+    vector<pair<GLuint, GLuint>> edges;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (!alive[t])
+            continue;
+        const GLuint* c = &corner[3 * t];
+        glm::dvec3 n = triangleNormal(c[0], c[1], c[2]);
+        double area = glm::length(n);
+        if (area > 0.0) {
+            n /= area;
+            Quadric q = Quadric::plane(n, -glm::dot(n, position[c[0]]), area * 0.5);
+            for (GLuint k = 0; k < 3; ++k)
+                quadric[c[k]] += q;
+        }
+        for (GLuint k = 0; k < 3; ++k)
+            edges.push_back(make_pair(min(c[k], c[(k + 1) % 3]), max(c[k], c[(k + 1) % 3])));
+    }
+    sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+        if (j - i == 1) {
+            // find the triangle of the border edge for its normal
+            GLuint a = edges[i].first, b = edges[i].second;
+            for (GLuint t: trianglesAt[a]) {
+                const GLuint* c = &corner[3 * t];
+                if (c[0] != b && c[1] != b && c[2] != b)
+                    continue;
+                glm::dvec3 n = triangleNormal(c[0], c[1], c[2]);
+                glm::dvec3 side = glm::cross(position[b] - position[a], n);
+                double length = glm::length(side);
+                if (length > 0.0) {
+                    side /= length;
+                    glm::dvec3 edge = position[b] - position[a];
+                    Quadric q = Quadric::plane(side, -glm::dot(side, position[a]), BORDER_WEIGHT * glm::dot(edge, edge));
+                    quadric[a] += q;
+                    quadric[b] += q;
+                }
+                break;
+            }
+        }
+        i = j;
+    }
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    // 4. collapse the cheapest edges; heap entries go stale when an end changes, versions detect that
+    struct Collapse {
+        double cost;
+        GLuint from, to;
+        GLuint fromVersion, toVersion;
+
+        bool operator <(const Collapse& other) const
+        {
+            return cost > other.cost;
+        }
+    };
+
+    vector<GLuint> version(positionCount, 0);
+    vector<bool> removed(positionCount, false);
+    priority_queue<Collapse> heap;
+
+    auto pushEdge = [&](GLuint a, GLuint b) {
+        Quadric q = quadric[a];
+        q += quadric[b];
+        double toB = q.meanError(position[b]);
+        double toA = q.meanError(position[a]);
+        if (toB <= toA)
+            heap.push(Collapse{toB, a, b, version[a], version[b]});
+        else
+            heap.push(Collapse{toA, b, a, version[b], version[a]});
+    };
+    for (const auto& edge: edges)
+        pushEdge(edge.first, edge.second);
+
+    // a collapse is refused when it would flip or degenerate a triangle that survives it
+    auto canCollapse = [&](GLuint from, GLuint to) {
+        for (GLuint t: trianglesAt[from]) {
+            if (!alive[t])
+                continue;
+            const GLuint* c = &corner[3 * t];
+            if (c[0] == to || c[1] == to || c[2] == to)
+                continue;
+            glm::dvec3 before = triangleNormal(c[0], c[1], c[2]);
+            GLuint moved[3] = {c[0] == from ? to : c[0], c[1] == from ? to : c[1], c[2] == from ? to : c[2]};
+            glm::dvec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+            double lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0 || glm::dot(before, after) < MIN_NORMAL_COSINE * lengths)
+                return false;
+        }
+        return true;
+    };
+
+    double maxCost = (double)maxError * maxError;
+    double worstCost = 0.0;
+    vector<GLuint> neighbours;
+    while (aliveCount > targetTriangles && !heap.empty()) {
+        Collapse collapse = heap.top();
+        heap.pop();
+        GLuint from = collapse.from, to = collapse.to;
+        if (removed[from] || removed[to] || version[from] != collapse.fromVersion || version[to] != collapse.toVersion)
+            continue;
+        if (collapse.cost > maxCost)
+            break;
+        if (!canCollapse(from, to))
+            continue;
+
+        worstCost = max(worstCost, collapse.cost);
+        for (GLuint t: trianglesAt[from]) {
+            if (!alive[t])
+                continue;
+            GLuint* c = &corner[3 * t];
+            if (c[0] == to || c[1] == to || c[2] == to) {
+                alive[t] = false;
+                --aliveCount;
+                continue;
+            }
+            for (GLuint k = 0; k < 3; ++k)
+                if (c[k] == from)
+                    c[k] = to;
+            trianglesAt[to].push_back(t);
+        }
+        vector<GLuint>().swap(trianglesAt[from]);
+        removed[from] = true;
+        quadric[to] += quadric[from];
+        ++version[to];
+
+        // drop dead triangles and requeue the edges around the kept end
+        vector<GLuint>& around = trianglesAt[to];
+        around.erase(remove_if(around.begin(), around.end(), [&](GLuint t) { return !alive[t]; }), around.end());
+        neighbours.clear();
+        for (GLuint t: around)
+            for (GLuint k = 0; k < 3; ++k)
+                if (corner[3 * t + k] != to)
+                    neighbours.push_back(corner[3 * t + k]);
+        sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (GLuint n: neighbours)
+            pushEdge(to, n);
+    }
+
+    // 5. back from positions to vertices
+    result.indices.reserve(aliveCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (!alive[t])
+            continue;
+        for (GLuint k = 0; k < 3; ++k) {
+            GLuint original = indices[3 * t + k];
+            GLuint now = corner[3 * t + k];
+            if (positionOf[original] == now) {
+                result.indices.push_back(original);
+                continue;
+            }
+            GLuint best = verticesAt[now][0];
+            GLfloat bestDot = -2.0f;
+            for (GLuint candidate: verticesAt[now]) {
+                GLfloat d = glm::dot(vertices[candidate].Normal, vertices[original].Normal);
+                if (d > bestDot) {
+                    bestDot = d;
+                    best = candidate;
+                }
+            }
+            result.indices.push_back(best);
+        }
+    }
+    result.error = (GLfloat)sqrt(worstCost);
+    return result;
+}
+
+// Builds up to levels coarser versions of a mesh, each with about half the triangles of the one before.
+// The chain ends early when a level would not be at least 10% smaller than the previous one.
+inline vector<MeshLodData> buildLodChain(const vector<Vertex>& vertices, const vector<GLuint>& indices, GLuint levels)
+{
+    vector<MeshLodData> lods;
+    if (vertices.empty())
+        return lods;
+
+    glm::vec3 boundsMin, boundsMax;
+    Mesh::computeBounds(vertices.data(), vertices.size(), boundsMin, boundsMax);
+    // coarse levels are picked only when their error is below a pixel anyway, this just keeps them recognizable
+    GLfloat maxError = 0.25f * glm::length(boundsMax - boundsMin);
+
+    size_t previous = indices.size() / 3;
+    for (GLuint level = 1; level <= levels; ++level) {
+        size_t target = previous / 2;
+        SimplifiedMesh simplified = simplifyMesh(vertices, indices, target, maxError);
+        size_t triangles = simplified.indices.size() / 3;
+        if (triangles == 0 || triangles * 10 > previous * 9)
+            break;
+        GLfloat error = lods.empty() ? simplified.error : max(simplified.error, lods.back().error);
+        lods.push_back(MeshLodData{std::move(simplified.indices), error});
+        previous = triangles;
+    }
+    return lods;
+}
+
+#endif
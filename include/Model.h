@@ -6,7 +6,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "AssetRegistry.h"
+#include "FramePacket.h"
+#include "InstanceRenderer.h"
+#include "RenderQueue.h"
 #include "Mesh.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
 #include "Shader.h"
 #include "Collision.h"
 #include "uuid.h"
@@ -14,6 +20,7 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <algorithm>
 #include <random>
 #include <vector>
@@ -23,22 +30,130 @@ using namespace std;
 
 vector<string> getElementsString(const string line, GLchar sep);
 
+// What Model::Draw needs to know about the camera to pick levels of detail.
+struct LodCamera {
+    glm::vec3 position = glm::vec3(0.0f);
+    // screen pixels covered by one world unit at distance 1
+    GLfloat pixelsPerUnit = 0.0f;
+    // a level is used while its simplification error projects to fewer pixels than this
+    GLfloat threshold = 1.0f;
+    // how far the projected error has to move past threshold before the level changes, as a fraction of it.
+    // Keeps models near the switch distance from flickering between two levels.
+    GLfloat hysteresis = 0.25f;
+};
+
+inline LodCamera& lodCamera()
+{
+    static LodCamera camera;
+    return camera;
+}
+
 class Model
 {
 public:
     // constructor, expects a filepath to a 3D model.
-    Model(string path)
+    // the meshes are shared with every other Model built from the same file (see AssetRegistry)
+    Model(string path, const ObjLoadOptions& options = ObjLoadOptions())
     {
-        loadModel(path);
+        this->asset = options.background ? assetRegistry().loadAsync(path, options) : assetRegistry().load(path, options);
         setOneModel();
     }
 
     // draws the model, and thus all its meshes
     void Draw(Shader& shader)
     {
+        // still loading in the background
+        if (!asset->isResident())
+            return;
+
         shader.setMat4("model", model);
-        for (GLuint i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        shader.setMat3("normalMatrix", normalMatrix);
+        this->lodLevels.resize(asset->meshes.size(), 0);
+        for (size_t i = 0; i < asset->meshes.size(); ++i) {
+            Mesh& mesh = asset->meshes[i];
+            this->lodLevels[i] = selectLod(mesh, this->lodLevels[i]);
+            mesh.Draw(shader, this->lodLevels[i]);
+        }
+    }
+
+    // queues the meshes of the model in renderer, which draws every copy of a mesh in one call (see InstanceRenderer)
+    void DrawInstanced(InstanceRenderer& renderer)
+    {
+        if (!asset->isResident())
+            return;
+
+        InstanceData instance{model, normalMatrix};
+        this->lodLevels.resize(asset->meshes.size(), 0);
+        for (size_t i = 0; i < asset->meshes.size(); ++i) {
+            Mesh& mesh = asset->meshes[i];
+            this->lodLevels[i] = selectLod(mesh, this->lodLevels[i]);
+            renderer.add(mesh, this->lodLevels[i], instance);
+        }
+    }
+
+    // queues the meshes of the model in queue, which draws them sorted by state when it is flushed
+    void Submit(RenderQueue& queue, Shader& shader)
+    {
+        if (!asset->isResident())
+            return;
+
+        this->lodLevels.resize(asset->meshes.size(), 0);
+        for (size_t i = 0; i < asset->meshes.size(); ++i) {
+            Mesh& mesh = asset->meshes[i];
+            this->lodLevels[i] = selectLod(mesh, this->lodLevels[i]);
+            queue.add(shader, mesh, this->lodLevels[i], model, normalMatrix);
+        }
+    }
+
+    // the same as DrawInstanced and Submit, into a frame packet for the render thread
+    void DrawInstanced(FramePacket& packet)
+    {
+        addToPacket(packet, nullptr);
+    }
+
+    void Submit(FramePacket& packet, Shader& shader)
+    {
+        addToPacket(packet, &shader);
+    }
+
+    // draws the model into the depth buffer of a software occlusion culler, for models that hide what is behind
+    // them (walls, floors). Their collision boxes are used when they have any, otherwise the CPU copy of the meshes,
+    // which meshes from a mesh cache or archive only keep when the model is loaded with ObjLoadOptions::occluder
+    void DrawOccluder(OcclusionCuller& culler)
+    {
+        if (!colrec.empty()) {
+            for (CollisionRectangle& box: colrec)
+                culler.addBox(box.getVertex());
+            return;
+        }
+        if (!asset->isResident() || !hasOccluderCopy())
+            return;
+        for (const Mesh& mesh: asset->meshes)
+            culler.addTriangles(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), model);
+    }
+
+    // the same as DrawOccluder(OcclusionCuller&), into a frame packet for the render thread
+    void DrawOccluder(FramePacket& packet)
+    {
+        if (!colrec.empty()) {
+            for (CollisionRectangle& box: colrec) {
+                vector<glm::vec3> corners = box.getVertex();
+                packet.occluderBoxes.insert(packet.occluderBoxes.end(), corners.begin(), corners.end());
+            }
+            return;
+        }
+        if (!asset->isResident() || !hasOccluderCopy())
+            return;
+        for (const Mesh& mesh: asset->meshes)
+            packet.occluderMeshes.push_back(FramePacketOccluder{&mesh, model});
+        packet.assets.push_back(asset);
+    }
+
+    // call once per frame before drawing, fovY in radians, viewportHeight in pixels
+    static void setLodCamera(glm::vec3 position, GLfloat fovY, GLfloat viewportHeight)
+    {
+        lodCamera().position = position;
+        lodCamera().pixelsPerUnit = viewportHeight / (2.0f * glm::tan(fovY * 0.5f));
     }
 
     void setTranslate(glm::vec3 a)
@@ -112,17 +227,88 @@ public:
         return this->uniqueNumber;
     }
 
+    bool isResident()
+    {
+        return this->asset->isResident();
+    }
+
+    shared_ptr<ModelAsset> getAsset()
+    {
+        return this->asset;
+    }
+
 private:
     // model data 
-    vector<Mesh> meshes;
+    shared_ptr<ModelAsset> asset;
     vector<CollisionRectangle> colrec;
     vector<CollisionSphere> sphereCollisions;
-    map<string, Material> materials;
     string directory;
     glm::mat4 model;
+    // transforms normals to world space, the inverse transpose of the upper 3x3 of model
+    glm::mat3 normalMatrix;
     string uniqueNumber;
     GLfloat rotateXY, rotateZY, rotateZX;
     glm::vec3 translate, scale;
+    // level of detail each mesh was drawn with last frame
+    vector<GLuint> lodLevels;
+    bool occluderReported = false;
+
+    // whether every mesh has the CPU copy occluders draw from, a model without it is reported once
+    bool hasOccluderCopy()
+    {
+        for (const Mesh& mesh: asset->meshes) {
+            if (mesh.vertices.empty() && mesh.lods[0].indexCount > 0) {
+                if (!occluderReported)
+                    cout << "ERROR::MODEL::OCCLUDER_WITHOUT_CPU_COPY (load it with ObjLoadOptions::occluder): " << asset->path << endl;
+                occluderReported = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // steps from the current level towards the coarsest one whose error stays below lodCamera().threshold pixels
+    GLuint selectLod(const Mesh& mesh, GLuint current)
+    {
+        const LodCamera& camera = lodCamera();
+        GLuint count = (GLuint)mesh.lods.size();
+        if (count <= 1 || camera.pixelsPerUnit <= 0.0f)
+            return 0;
+
+        GLfloat maxScale = glm::max(glm::abs(scale.x), glm::max(glm::abs(scale.y), glm::abs(scale.z)));
+        glm::vec3 centre = glm::vec3(model * glm::vec4(mesh.sphereCentre, 1.0f));
+        GLfloat radius = mesh.sphereRadius * maxScale;
+        // distance to the nearest point of the bounding sphere, inside it the full mesh is drawn
+        GLfloat distance = glm::length(camera.position - centre) - radius;
+        if (distance <= 0.0f)
+            return 0;
+
+        auto pixelError = [&](GLuint level) {
+            return mesh.lods[level].error * maxScale * camera.pixelsPerUnit / distance;
+        };
+        current = min(current, count - 1);
+        while (current > 0 && pixelError(current) > camera.threshold * (1.0f + camera.hysteresis))
+            --current;
+        while (current + 1 < count && pixelError(current + 1) <= camera.threshold * (1.0f - camera.hysteresis))
+            ++current;
+        return current;
+    }
+
+    // the meshes with their levels of detail and transforms, shader nullptr for the InstanceRenderer
+    void addToPacket(FramePacket& packet, Shader* shader)
+    {
+        PROFILE_ZONE("submit");
+        if (!asset->isResident())
+            return;
+
+        this->lodLevels.resize(asset->meshes.size(), 0);
+        for (size_t i = 0; i < asset->meshes.size(); ++i) {
+            Mesh& mesh = asset->meshes[i];
+            this->lodLevels[i] = selectLod(mesh, this->lodLevels[i]);
+            packet.draws.push_back(FramePacketDraw{&mesh, this->lodLevels[i], model, normalMatrix, shader});
+        }
+        packet.assets.push_back(asset);
+    }
 
     void setOneModel()
     {
@@ -136,97 +322,6 @@ private:
         setCollisionModel();
     }
 
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(const string& path)
-    {
-        vector<string> lines;
-        string line;
-        string directory = path.substr(0, path.find_last_of('/')) + "/";
-        string nameMaterial;
-
-        vector<glm::vec3> vertex;
-        vector<glm::vec3> normal;
-        vector<Vertex> vertices;
-        vector<GLuint> indices;
-        
-        ifstream in(path);
-        if (in.is_open())
-            while (getline(in, line))
-                lines.push_back(line);
-        in.close();
-
-        for (string line: lines) {
-            vector<string> elements = getElementsString(line, ' ');
-
-            if (elements[0] == "o") {
-                if (vertices.empty())
-                    continue;
-
-                this->meshes.push_back(Mesh(vertices, indices, this->materials[nameMaterial]));
-                vertices.clear();
-                indices.clear();
-            }
-            else if (elements[0] == "mtllib")
-                setMaterials(directory + elements[1]);
-            else if (elements[0] == "v")
-                vertex.push_back(glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3])));
-            else if (elements[0] == "vn")
-                normal.push_back(glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3])));
-            else if (elements[0] == "usemtl")
-                nameMaterial = elements[1];
-            else if (elements[0] == "f") {
-                for (GLuint i = 1; i < 4; ++i) {
-                    vector<string> a = getElementsString(elements[i], '/');
-
-                    Vertex now;
-                    now.Position = vertex[stoi(a[0]) - 1];
-                    now.Normal = normal[stoi(a[1]) - 1];
-
-                    auto search = find(vertices.begin(), vertices.end(), now);
-
-                    if (search == vertices.end()) {
-                        indices.push_back(vertices.size());
-                        vertices.push_back(now);
-                    }
-                    else
-                        indices.push_back(search - vertices.begin());
-                }
-            }
-        }
-
-        if (!vertices.empty())
-            this->meshes.push_back(Mesh(vertices, indices, this->materials[nameMaterial]));
-    }
-
-    void setMaterials(const string& path) {
-        map<string, Material> materials;
-        string line, nameMaterial;
-        vector<string> lines;
-
-        ifstream in(path);
-        if (in.is_open())
-            while (getline(in, line))
-                lines.push_back(line);
-        in.close();
-
-        for (string line: lines) {
-            vector<string> elements = getElementsString(line, ' ');
-
-            if (elements[0] == "newmtl")
-                nameMaterial = elements[1];
-            else if (elements[0] == "Ns")
-                materials[nameMaterial].Shininess = stof(elements[1]);
-            else if (elements[0] == "Ka")
-                materials[nameMaterial].Ambient = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
-            else if (elements[0] == "Kd")
-                materials[nameMaterial].Diffuse = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
-            else if (elements[0] == "Ks")
-                materials[nameMaterial].Specular = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
-        }
-
-        this->materials = materials;
-    }
-
     void setModel()
     {
         glm::mat4 model(1.0f);
@@ -236,6 +331,12 @@ private:
         model = glm::rotate(model, rotateZY, glm::vec3(1.0, 0.0f, 0.0f));
         model = glm::scale(model, scale);
         this->model = model;
+
+        // with a uniform scale s the 3x3 part is s * rotation, whose inverse transpose is rotation / s
+        if (scale.x == scale.y && scale.y == scale.z && scale.x != 0.0f)
+            this->normalMatrix = glm::mat3(model) / (scale.x * scale.x);
+        else
+            this->normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
     }
 
     void setCollisionModel()
@@ -0,0 +1,279 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "VertexWelder.h"
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+// CPU side result of parsing one mesh ("o" block) of an OBJ file
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    string material;
+    // coarser levels of detail, filled when ObjLoadOptions::lodLevels asks for them
+    vector<MeshLodData> lods;
+};
+
+// CPU side result of parsing a whole OBJ file with its MTL library
+struct ModelData {
+    vector<MeshData> meshes;
+    map<string, Material> materials;
+    // paths of the MTL libraries the OBJ file referenced
+    vector<string> libraries;
+};
+
+struct ObjLoadOptions {
+    // corners closer than this (position and normal) share a vertex, 0 welds by (v, vn) index only
+    GLfloat weldEpsilon = 0.0f;
+    // threads parsing the file (see loadObjParallel), 0 uses every hardware thread, 1 stays single threaded
+    unsigned threads = 1;
+    // reorder triangles and vertices for the post-transform cache and vertex fetch (see MeshOptimizer.h)
+    bool optimizeMeshes = false;
+    // upload meshes as PackedVertex with 16-bit indices where possible (see Mesh.h)
+    bool compressVertices = false;
+    // coarser levels of detail built per mesh by quadric simplification (see MeshSimplifier.h), at most 15
+    GLuint lodLevels = 0;
+    // Model keeps the loaded meshes in a binary cache next to the OBJ file (see MeshCache.h)
+    // and maps that instead of parsing while the OBJ and MTL files are unchanged
+    bool meshCache = true;
+    // Model returns at once and the file is loaded in the background (see AssetRegistry::loadAsync),
+    // the model draws nothing until its meshes are uploaded
+    bool background = false;
+    // the model is drawn as an occluder (see Model::DrawOccluder): meshes from a mesh cache or archive then keep a CPU
+    // copy decoded from the blobs, the others upload the blobs and keep only their bounds. Parsed meshes always have one
+    bool occluder = false;
+};
+
+bool loadObj(const string& path, ModelData& data, const ObjLoadOptions& options = ObjLoadOptions());
+bool loadMtl(const string& path, map<string, Material>& materials);
+
+// Allocation free tokenizer over a memory-mapped text file.
+namespace objtext {
+    inline bool isBlank(GLchar c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // cuts the next line (without '\n') from the front of text
+    inline string_view nextLine(string_view& text)
+    {
+        size_t end = text.find('\n');
+        string_view line;
+        if (end == string_view::npos) {
+            line = text;
+            text = string_view();
+        }
+        else {
+            line = text.substr(0, end);
+            text.remove_prefix(end + 1);
+        }
+        return line;
+    }
+
+    // cuts the next blank separated token from the front of line
+    inline string_view nextToken(string_view& line)
+    {
+        size_t i = 0;
+        while (i < line.size() && isBlank(line[i]))
+            ++i;
+        size_t start = i;
+        while (i < line.size() && !isBlank(line[i]))
+            ++i;
+        string_view token = line.substr(start, i - start);
+        line.remove_prefix(i);
+        return token;
+    }
+
+    // the rest of the line without surrounding blanks (names may contain spaces)
+    inline string_view restOfLine(string_view line)
+    {
+        size_t start = 0, end = line.size();
+        while (start < end && isBlank(line[start]))
+            ++start;
+        while (end > start && isBlank(line[end - 1]))
+            --end;
+        return line.substr(start, end - start);
+    }
+
+    inline GLfloat toFloat(string_view token)
+    {
+        GLfloat value = 0.0f;
+        if (!token.empty() && token[0] == '+')
+            token.remove_prefix(1);
+        from_chars(token.data(), token.data() + token.size(), value);
+        return value;
+    }
+
+    inline GLint toInt(string_view token)
+    {
+        GLint value = 0;
+        if (!token.empty() && token[0] == '+')
+            token.remove_prefix(1);
+        from_chars(token.data(), token.data() + token.size(), value);
+        return value;
+    }
+
+    inline glm::vec3 toVec3(string_view& line)
+    {
+        GLfloat x = toFloat(nextToken(line));
+        GLfloat y = toFloat(nextToken(line));
+        GLfloat z = toFloat(nextToken(line));
+        return glm::vec3(x, y, z);
+    }
+
+    // OBJ indices are 1-based, negative ones are relative to the end of the list
+    inline GLint resolveIndex(GLint index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return (GLint)count + index;
+        return -1;
+    }
+
+    // splits "v", "v/vt", "v//vn" or "v/vt/vn" into the position and normal indices
+    inline void toCorner(string_view token, GLint& v, GLint& vn)
+    {
+        size_t first = token.find('/');
+        v = toInt(token.substr(0, first));
+        vn = 0;
+        if (first == string_view::npos)
+            return;
+        size_t second = token.find('/', first + 1);
+        if (second != string_view::npos)
+            vn = toInt(token.substr(second + 1));
+    }
+
+    // resolves a corner index against the count of elements read so far, negative when it is invalid
+    inline GLint resolveCorner(GLint index, size_t count)
+    {
+        GLint resolved = resolveIndex(index, count);
+        return resolved >= (GLint)count ? -1 : resolved;
+    }
+
+    // calls emit(v, vn) for the corners of the "f" line, polygons are triangulated as a fan around the first corner
+    template <typename F>
+    inline void forEachFaceCorner(string_view line, F emit)
+    {
+        GLint corners[3][2];
+        GLuint count = 0;
+        for (string_view token = nextToken(line); !token.empty(); token = nextToken(line)) {
+            GLint v, vn;
+            toCorner(token, v, vn);
+            if (count < 3) {
+                corners[count][0] = v;
+                corners[count][1] = vn;
+            }
+            else {
+                corners[1][0] = corners[2][0];
+                corners[1][1] = corners[2][1];
+                corners[2][0] = v;
+                corners[2][1] = vn;
+            }
+            if (++count >= 3)
+                for (GLuint i = 0; i < 3; ++i)
+                    emit(corners[i][0], corners[i][1]);
+        }
+    }
+}
+
+inline bool loadObj(const string& path, ModelData& data, const ObjLoadOptions& options)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    size_t slash = path.find_last_of('/');
+    string directory = slash == string::npos ? "" : path.substr(0, slash + 1);
+
+    vector<glm::vec3> vertex;
+    vector<glm::vec3> normal;
+    MeshData mesh;
+    string nameMaterial;
+    VertexWelder welder(options.weldEpsilon);
+    welder.begin(&mesh.vertices, &mesh.indices);
+
+    auto addCorner = [&](GLint v, GLint vn) {
+        GLint iv = objtext::resolveCorner(v, vertex.size());
+        GLint in = objtext::resolveCorner(vn, normal.size());
+        welder.add(iv, in, iv >= 0 ? vertex[iv] : glm::vec3(0.0f), in >= 0 ? normal[in] : glm::vec3(0.0f));
+    };
+
+    string_view text = file.view();
+    while (!text.empty()) {
+        string_view line = objtext::nextLine(text);
+        string_view keyword = objtext::nextToken(line);
+
+        if (keyword == "v")
+            vertex.push_back(objtext::toVec3(line));
+        else if (keyword == "vn")
+            normal.push_back(objtext::toVec3(line));
+        else if (keyword == "f")
+            objtext::forEachFaceCorner(line, addCorner);
+        else if (keyword == "o") {
+            if (mesh.vertices.empty())
+                continue;
+
+            mesh.material = nameMaterial;
+            data.meshes.push_back(std::move(mesh));
+            mesh = MeshData();
+            welder.begin(&mesh.vertices, &mesh.indices);
+        }
+        else if (keyword == "usemtl")
+            nameMaterial = string(objtext::restOfLine(line));
+        else if (keyword == "mtllib") {
+            data.libraries.push_back(directory + string(objtext::restOfLine(line)));
+            loadMtl(data.libraries.back(), data.materials);
+        }
+    }
+
+    if (!mesh.vertices.empty()) {
+        mesh.material = nameMaterial;
+        data.meshes.push_back(std::move(mesh));
+    }
+
+    return true;
+}
+
+inline bool loadMtl(const string& path, map<string, Material>& materials)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    Material* material = nullptr;
+    string_view text = file.view();
+    while (!text.empty()) {
+        string_view line = objtext::nextLine(text);
+        string_view keyword = objtext::nextToken(line);
+
+        if (keyword == "newmtl")
+            material = &materials[string(objtext::restOfLine(line))];
+        else if (material == nullptr)
+            continue;
+        else if (keyword == "Ns")
+            material->Shininess = objtext::toFloat(objtext::nextToken(line));
+        else if (keyword == "Ka")
+            material->Ambient = objtext::toVec3(line);
+        else if (keyword == "Kd")
+            material->Diffuse = objtext::toVec3(line);
+        else if (keyword == "Ks")
+            material->Specular = objtext::toVec3(line);
+    }
+
+    return true;
+}
+
+#endif
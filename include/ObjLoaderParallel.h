@@ -0,0 +1,305 @@
+#ifndef OBJLOADERPARALLEL_H
+#define OBJLOADERPARALLEL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+#include "Parallel.h"
+#include "VertexWelder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+bool loadObjParallel(const string& path, ModelData& data, const ObjLoadOptions& options = ObjLoadOptions());
+
+// Multi-threaded OBJ loading. The mapped file is cut into chunks at line boundaries and every chunk is
+// tokenized on its own thread. The chunks are then stitched together with prefix-summed v/vn offsets,
+// each run of corners is welded locally and the local vertices are merged into their mesh in file order,
+// so the result is exactly the one loadObj produces.
+namespace objparallel {
+    // chunks smaller than this are not worth a thread
+    const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    // an "o", "usemtl" or "mtllib" line, placed before the corner it precedes in its chunk
+    struct Event {
+        GLchar type;
+        size_t corner;
+        string_view name;
+    };
+
+    // the v/vn counts of the chunk seen by the corners starting at corner
+    struct CountMark {
+        size_t corner;
+        GLuint vertices, normals;
+    };
+
+    struct Chunk {
+        string_view text;
+        vector<glm::vec3> vertex;
+        vector<glm::vec3> normal;
+        // raw (v, vn) OBJ index pairs of the triangulated faces
+        vector<GLint> corners;
+        vector<CountMark> marks;
+        vector<Event> events;
+        GLuint vertexOffset = 0, normalOffset = 0;
+    };
+
+    // a run of corners of one chunk that belongs to one mesh
+    struct Segment {
+        size_t chunk, begin, end;
+        // the mesh of the run and its position in the index list of that mesh
+        size_t mesh, firstIndex;
+        // (v, vn) keys of the locally welded vertices in order of first use, and the corners as indices into them
+        vector<uint64_t> keys;
+        vector<GLuint> indices;
+        // local vertex -> mesh vertex
+        vector<GLuint> remap;
+    };
+
+    struct MeshPlan {
+        vector<size_t> segments;
+        string material;
+        size_t corners = 0;
+    };
+
+    // splits text into at most count pieces, every piece ends at a line end
+    inline vector<string_view> splitLines(string_view text, size_t count)
+    {
+        vector<string_view> pieces;
+        size_t step = text.size() / max<size_t>(count, 1) + 1;
+        while (!text.empty()) {
+            size_t end = min(step, text.size());
+            size_t newline = text.find('\n', end - 1);
+            end = newline == string_view::npos ? text.size() : newline + 1;
+            pieces.push_back(text.substr(0, end));
+            text.remove_prefix(end);
+        }
+        return pieces;
+    }
+
+    inline void parseChunk(Chunk& chunk)
+    {
+        string_view text = chunk.text;
+        while (!text.empty()) {
+            string_view line = objtext::nextLine(text);
+            string_view keyword = objtext::nextToken(line);
+
+            if (keyword == "v")
+                chunk.vertex.push_back(objtext::toVec3(line));
+            else if (keyword == "vn")
+                chunk.normal.push_back(objtext::toVec3(line));
+            else if (keyword == "f") {
+                // relative and out of range indices depend on the counts at this face
+                if (chunk.marks.empty() || chunk.marks.back().vertices != chunk.vertex.size() || chunk.marks.back().normals != chunk.normal.size())
+                    chunk.marks.push_back(CountMark{chunk.corners.size() / 2, (GLuint)chunk.vertex.size(), (GLuint)chunk.normal.size()});
+                objtext::forEachFaceCorner(line, [&](GLint v, GLint vn) {
+                    chunk.corners.push_back(v);
+                    chunk.corners.push_back(vn);
+                });
+            }
+            else if (keyword == "o")
+                chunk.events.push_back(Event{'o', chunk.corners.size() / 2, string_view()});
+            else if (keyword == "usemtl")
+                chunk.events.push_back(Event{'u', chunk.corners.size() / 2, objtext::restOfLine(line)});
+            else if (keyword == "mtllib")
+                chunk.events.push_back(Event{'m', chunk.corners.size() / 2, objtext::restOfLine(line)});
+        }
+    }
+
+    // calls emit(iv, in) with the resolved indices of the corners [begin, end) of the chunk
+    template <typename F>
+    inline void forEachResolvedCorner(const Chunk& chunk, size_t begin, size_t end, F emit)
+    {
+        auto mark = upper_bound(chunk.marks.begin(), chunk.marks.end(), begin,
+            [](size_t corner, const CountMark& m) { return corner < m.corner; }) - 1;
+        for (size_t c = begin; c < end; ++c) {
+            while (mark + 1 != chunk.marks.end() && (mark + 1)->corner <= c)
+                ++mark;
+            GLint iv = objtext::resolveCorner(chunk.corners[2 * c], chunk.vertexOffset + mark->vertices);
+            GLint in = objtext::resolveCorner(chunk.corners[2 * c + 1], chunk.normalOffset + mark->normals);
+            emit(iv, in);
+        }
+    }
+
+    inline uint64_t cornerKey(GLint iv, GLint in)
+    {
+        return ((uint64_t)(uint32_t)iv << 32) | (uint32_t)in;
+    }
+
+    inline void weldSegment(const Chunk& chunk, Segment& segment)
+    {
+        // reused by the segments a thread welds, objects are often small
+        thread_local WeldTable table;
+        table.clear((segment.end - segment.begin) / 2);
+        segment.indices.reserve(segment.end - segment.begin);
+        forEachResolvedCorner(chunk, segment.begin, segment.end, [&](GLint iv, GLint in) {
+            uint64_t key = cornerKey(iv, in);
+            GLuint index = table.findOrInsert(key, (GLuint)segment.keys.size());
+            if (index == segment.keys.size())
+                segment.keys.push_back(key);
+            segment.indices.push_back(index);
+        });
+    }
+}
+
+inline bool loadObjParallel(const string& path, ModelData& data, const ObjLoadOptions& options)
+{
+    using namespace objparallel;
+
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    size_t slash = path.find_last_of('/');
+    string directory = slash == string::npos ? "" : path.substr(0, slash + 1);
+
+    unsigned threads = resolveThreadCount(options.threads);
+    size_t pieces = max<size_t>(1, min<size_t>(threads, file.size() / MIN_CHUNK_SIZE));
+
+    // 1. tokenize the chunks independently
+    vector<string_view> texts = splitLines(file.view(), pieces);
+    vector<Chunk> chunks(texts.size());
+    for (size_t i = 0; i < chunks.size(); ++i)
+        chunks[i].text = texts[i];
+    parallelFor(chunks.size(), threads, [&](size_t i) { parseChunk(chunks[i]); });
+
+    // 2. prefix sums of the element counts, then gather the global v/vn lists
+    size_t vertexCount = 0, normalCount = 0;
+    for (Chunk& chunk: chunks) {
+        chunk.vertexOffset = (GLuint)vertexCount;
+        chunk.normalOffset = (GLuint)normalCount;
+        vertexCount += chunk.vertex.size();
+        normalCount += chunk.normal.size();
+    }
+
+    vector<glm::vec3> vertex(vertexCount);
+    vector<glm::vec3> normal(normalCount);
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        Chunk& chunk = chunks[i];
+        if (!chunk.vertex.empty())
+            memcpy(&vertex[chunk.vertexOffset], chunk.vertex.data(), chunk.vertex.size() * sizeof(glm::vec3));
+        if (!chunk.normal.empty())
+            memcpy(&normal[chunk.normalOffset], chunk.normal.data(), chunk.normal.size() * sizeof(glm::vec3));
+        vector<glm::vec3>().swap(chunk.vertex);
+        vector<glm::vec3>().swap(chunk.normal);
+    });
+
+    // 3. replay the "o"/"usemtl"/"mtllib" lines in file order to cut the corners into meshes
+    vector<Segment> segments;
+    vector<MeshPlan> plans;
+    MeshPlan plan;
+    string nameMaterial;
+
+    auto addSegment = [&](size_t chunk, size_t begin, size_t end) {
+        if (begin == end)
+            return;
+        Segment segment;
+        segment.chunk = chunk;
+        segment.begin = begin;
+        segment.end = end;
+        segment.mesh = plans.size();
+        segment.firstIndex = plan.corners;
+        plan.corners += end - begin;
+        plan.segments.push_back(segments.size());
+        segments.push_back(std::move(segment));
+    };
+
+    auto flushMesh = [&]() {
+        if (plan.corners == 0)
+            return;
+        plan.material = nameMaterial;
+        plans.push_back(std::move(plan));
+        plan = MeshPlan();
+    };
+
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        size_t cursor = 0;
+        for (const Event& event: chunks[c].events) {
+            addSegment(c, cursor, event.corner);
+            cursor = event.corner;
+            if (event.type == 'o')
+                flushMesh();
+            else if (event.type == 'u')
+                nameMaterial = string(event.name);
+            else if (event.type == 'm') {
+                data.libraries.push_back(directory + string(event.name));
+                loadMtl(data.libraries.back(), data.materials);
+            }
+        }
+        addSegment(c, cursor, chunks[c].corners.size() / 2);
+    }
+    flushMesh();
+
+    size_t firstMesh = data.meshes.size();
+    data.meshes.resize(firstMesh + plans.size());
+
+    auto makeVertex = [&](GLint iv, GLint in) {
+        return Vertex{iv >= 0 ? vertex[iv] : glm::vec3(0.0f), in >= 0 ? normal[in] : glm::vec3(0.0f)};
+    };
+
+    // positional welding depends on the order every earlier vertex was added in, so each mesh is welded whole
+    if (options.weldEpsilon > 0.0f) {
+        parallelFor(plans.size(), threads, [&](size_t m) {
+            MeshData& mesh = data.meshes[firstMesh + m];
+            mesh.material = plans[m].material;
+            VertexWelder welder(options.weldEpsilon);
+            welder.begin(&mesh.vertices, &mesh.indices);
+            for (size_t s: plans[m].segments)
+                forEachResolvedCorner(chunks[segments[s].chunk], segments[s].begin, segments[s].end, [&](GLint iv, GLint in) {
+                    Vertex now = makeVertex(iv, in);
+                    welder.add(iv, in, now.Position, now.Normal);
+                });
+        });
+        return true;
+    }
+
+    // 4. weld every run of corners on its own
+    parallelFor(segments.size(), threads, [&](size_t s) { weldSegment(chunks[segments[s].chunk], segments[s]); });
+
+    // 5. merge the local vertices of each mesh in file order, which keeps the first-use numbering of loadObj
+    parallelFor(plans.size(), threads, [&](size_t m) {
+        MeshData& mesh = data.meshes[firstMesh + m];
+        mesh.material = plans[m].material;
+        mesh.indices.resize(plans[m].corners);
+
+        size_t expected = 0;
+        for (size_t s: plans[m].segments)
+            expected += segments[s].keys.size();
+        thread_local WeldTable table;
+        table.clear(expected);
+
+        for (size_t s: plans[m].segments) {
+            Segment& segment = segments[s];
+            segment.remap.resize(segment.keys.size());
+            for (size_t k = 0; k < segment.keys.size(); ++k) {
+                uint64_t key = segment.keys[k];
+                GLuint index = table.findOrInsert(key, (GLuint)mesh.vertices.size());
+                if (index == mesh.vertices.size())
+                    mesh.vertices.push_back(makeVertex((GLint)(key >> 32), (GLint)(uint32_t)key));
+                segment.remap[k] = index;
+            }
+        }
+    });
+
+    // 6. translate the local indices
+    parallelFor(segments.size(), threads, [&](size_t s) {
+        Segment& segment = segments[s];
+        GLuint* indices = data.meshes[firstMesh + segment.mesh].indices.data() + segment.firstIndex;
+        for (size_t j = 0; j < segment.indices.size(); ++j)
+            indices[j] = segment.remap[segment.indices[j]];
+    });
+
+    return true;
+}
+
+#endif
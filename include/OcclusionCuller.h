@@ -0,0 +1,320 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSIONCULLER_SSE
+#endif
+
+using namespace std;
+
+// what an OcclusionCuller did since its last begin
+struct OcclusionStats {
+    size_t occluders = 0;
+    // occluder triangles left after clipping, the ones the rasterizer drew
+    size_t triangles = 0;
+    size_t tested = 0, culled = 0;
+};
+
+// Software occlusion culling, entirely on the CPU. Each frame:
+// begin(viewProjection), add the big solid objects (walls, floors) with addBox / addTriangles, then finish,
+// which rasterizes them into a small depth buffer (horizontal bands on several threads, 4 pixels per SSE step)
+// and builds a hierarchical-Z pyramid from it, each texel the farthest depth of the 2x2 below.
+// visible then tests a box: it is hidden when its nearest point is behind the farthest occluder depth over
+// the few pyramid texels its screen rectangle covers. Boxes crossing the near plane always count as visible.
+class OcclusionCuller
+{
+public:
+    // the depth buffer is width x height pixels, width a multiple of 4; threads 0 uses one per hardware thread
+    OcclusionCuller(GLuint width = 256, GLuint height = 128, unsigned threads = 0)
+    {
+        this->width = (width + 3) / 4 * 4;
+        this->height = height;
+        this->threads = threads;
+        depth.assign(this->width * this->height, 1.0f);
+    }
+
+    void begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        stats = OcclusionStats();
+        ready = false;
+    }
+
+    // a box occluder given by its 8 world space corners, ordered as CollisionRectangle keeps them:
+    // the bottom face 0-3 around, then the top face 4-7 above it
+    void addBox(const vector<glm::vec3>& corners)
+    {
+        static const GLuint faces[36] = {
+            0, 1, 2, 0, 2, 3,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+            1, 2, 6, 1, 6, 5,  2, 3, 7, 2, 7, 6,  3, 0, 4, 3, 4, 7
+        };
+        if (corners.size() < 8)
+            return;
+        glm::vec4 clip[8];
+        for (GLuint i = 0; i < 8; ++i)
+            clip[i] = viewProjection * glm::vec4(corners[i], 1.0f);
+        for (GLuint i = 0; i < 36; i += 3)
+            addClipTriangle(clip[faces[i]], clip[faces[i + 1]], clip[faces[i + 2]]);
+        ++stats.occluders;
+    }
+
+    // an occluder mesh, positions in object space moved by model
+    void addTriangles(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, const glm::mat4& model)
+    {
+        glm::mat4 transform = viewProjection * model;
+        clipVertices.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+            clipVertices[i] = transform * glm::vec4(vertices[i].Position, 1.0f);
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+            addClipTriangle(clipVertices[indices[i]], clipVertices[indices[i + 1]], clipVertices[indices[i + 2]]);
+        ++stats.occluders;
+    }
+
+    // rasterizes the occluders and builds the pyramid, visible can be used afterwards
+    void finish()
+    {
+        fill(depth.begin(), depth.end(), 1.0f);
+        stats.triangles = triangles.size();
+
+        // every band walks the whole triangle list and writes only its own rows, so no locking is needed
+        const GLuint bandHeight = 16;
+        size_t bands = (height + bandHeight - 1) / bandHeight;
+        frameWorkers().parallelFor(bands, threads, [&](size_t band) {
+            GLuint top = (GLuint)band * bandHeight;
+            GLuint bottom = min(top + bandHeight, height);
+            for (const ScreenTriangle& triangle: triangles)
+                rasterize(triangle, top, bottom);
+        });
+
+        buildPyramid();
+        ready = true;
+    }
+
+    // whether the object space box [boundsMin, boundsMax] moved by model may be seen past the occluders
+    bool visible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model)
+    {
+        if (!ready)
+            return true;
+        ++stats.tested;
+
+        glm::mat4 transform = viewProjection * model;
+        glm::vec2 low(1e30f), high(-1e30f);
+        GLfloat nearest = 1.0f;
+        for (GLuint i = 0; i < 8; ++i) {
+            glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+            glm::vec4 clip = transform * glm::vec4(corner, 1.0f);
+            if (clip.w <= NEAR_W || clip.z < -clip.w)
+                return true;
+            glm::vec3 screen = toScreen(clip);
+            low = glm::min(low, glm::vec2(screen));
+            high = glm::max(high, glm::vec2(screen));
+            nearest = min(nearest, screen.z);
+        }
+
+        // pixels the rectangle touches, off screen it is for frustum culling to decide
+        GLint x0 = max((GLint)floor(low.x), 0), y0 = max((GLint)floor(low.y), 0);
+        GLint x1 = min((GLint)floor(high.x), (GLint)width - 1), y1 = min((GLint)floor(high.y), (GLint)height - 1);
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        // the level where the rectangle spans at most 2 texels each way
+        GLuint level = 0;
+        while (level + 1 < pyramid.size() && max(x1 - x0, y1 - y0) >> level > 1)
+            ++level;
+        const Level& mip = pyramid[level];
+        // odd sizes fold their last pixels into the last texel of the next level
+        GLint lastX = min(x1 >> level, (GLint)mip.width - 1), lastY = min(y1 >> level, (GLint)mip.height - 1);
+        for (GLint y = min(y0 >> level, lastY); y <= lastY; ++y)
+            for (GLint x = min(x0 >> level, lastX); x <= lastX; ++x)
+                if (nearest - DEPTH_BIAS <= mip.depth[y * mip.width + x])
+                    return true;
+        ++stats.culled;
+        return false;
+    }
+
+    const OcclusionStats& getStats() const
+    {
+        return this->stats;
+    }
+
+    GLuint getWidth() const
+    {
+        return this->width;
+    }
+
+    GLuint getHeight() const
+    {
+        return this->height;
+    }
+
+    // the full resolution depth after finish, window depth in [0, 1], row 0 at the bottom
+    const vector<GLfloat>& getDepth() const
+    {
+        return this->depth;
+    }
+
+private:
+    // clip space w below which a vertex counts as on the camera plane
+    static constexpr GLfloat NEAR_W = 1e-5f;
+    // keeps an occluder from hiding its own box through rounding in the interpolated depth
+    static constexpr GLfloat DEPTH_BIAS = 1e-6f;
+
+    // pixel coordinates and window depth of the corners
+    struct ScreenTriangle {
+        glm::vec3 a, b, c;
+    };
+
+    struct Level {
+        GLuint width, height;
+        vector<GLfloat> depth;
+    };
+
+    GLuint width, height;
+    unsigned threads;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    vector<ScreenTriangle> triangles;
+    vector<glm::vec4> clipVertices;
+    vector<GLfloat> depth;
+    vector<Level> pyramid;
+    OcclusionStats stats;
+    bool ready = false;
+
+    glm::vec3 toScreen(const glm::vec4& clip) const
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // clips a triangle against the near plane (z = -w), the part in front becomes one or two screen triangles
+    void addClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        const glm::vec4* in[3] = {&a, &b, &c};
+        // entirely outside one side plane
+        for (GLuint axis = 0; axis < 3; ++axis) {
+            if (a[axis] > a.w && b[axis] > b.w && c[axis] > c.w)
+                return;
+            if (a[axis] < -a.w && b[axis] < -b.w && c[axis] < -c.w)
+                return;
+        }
+
+        glm::vec4 polygon[4];
+        GLuint count = 0;
+        for (GLuint i = 0; i < 3; ++i) {
+            const glm::vec4& p = *in[i];
+            const glm::vec4& q = *in[(i + 1) % 3];
+            GLfloat dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f)
+                polygon[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                polygon[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        for (GLuint i = 0; i < count; ++i)
+            if (polygon[i].w <= NEAR_W)
+                return;
+        for (GLuint i = 2; i < count; ++i)
+            triangles.push_back(ScreenTriangle{toScreen(polygon[0]), toScreen(polygon[i - 1]), toScreen(polygon[i])});
+    }
+
+    // draws the rows [top, bottom) of a triangle, keeping the nearest depth of every pixel whose centre it covers
+    void rasterize(const ScreenTriangle& triangle, GLuint top, GLuint bottom)
+    {
+        glm::vec3 a = triangle.a, b = triangle.b, c = triangle.c;
+        GLfloat area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (fabs(area) < 1e-8f)
+            return;
+        // both windings are drawn, turn clockwise triangles around
+        if (area < 0.0f) {
+            swap(b, c);
+            area = -area;
+        }
+
+        GLint x0 = max((GLint)floor(min(a.x, min(b.x, c.x))), 0);
+        GLint x1 = min((GLint)ceil(max(a.x, max(b.x, c.x))), (GLint)width - 1);
+        GLint y0 = max((GLint)floor(min(a.y, min(b.y, c.y))), (GLint)top);
+        GLint y1 = min((GLint)ceil(max(a.y, max(b.y, c.y))), (GLint)bottom - 1);
+        if (x0 > x1 || y0 > y1)
+            return;
+        // SSE steps cover 4 pixels from a multiple of 4
+        x0 &= ~3;
+
+        // edge functions e(x, y) = A x + B y + C, each one the (doubled) area opposite a corner
+        GLfloat A0 = b.y - c.y, B0 = c.x - b.x, C0 = b.x * c.y - b.y * c.x;
+        GLfloat A1 = c.y - a.y, B1 = a.x - c.x, C1 = c.x * a.y - c.y * a.x;
+        GLfloat A2 = a.y - b.y, B2 = b.x - a.x, C2 = a.x * b.y - a.y * b.x;
+        // depth is linear in screen space: z = a.z + (b.z - a.z) e1 / area + (c.z - a.z) e2 / area
+        GLfloat zB = (b.z - a.z) / area, zC = (c.z - a.z) / area;
+
+        for (GLint y = y0; y <= y1; ++y) {
+            GLfloat py = y + 0.5f;
+            GLfloat* row = &depth[y * width];
+#if defined(OCCLUSIONCULLER_SSE)
+            __m128 steps = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            for (GLint x = x0; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((GLfloat)x), steps);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(A0)), _mm_set1_ps(B0 * py + C0));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(A1)), _mm_set1_ps(B1 * py + C1));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(A2)), _mm_set1_ps(B2 * py + C2));
+                __m128 zero = _mm_setzero_ps();
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_set1_ps(a.z), _mm_add_ps(_mm_mul_ps(e1, _mm_set1_ps(zB)), _mm_mul_ps(e2, _mm_set1_ps(zC))));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (GLint x = x0; x <= x1; ++x) {
+                GLfloat px = x + 0.5f;
+                GLfloat e0 = A0 * px + (B0 * py + C0), e1 = A1 * px + (B1 * py + C1), e2 = A2 * px + (B2 * py + C2);
+                if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f)
+                    continue;
+                row[x] = min(row[x], a.z + (e1 * zB + e2 * zC));
+            }
+#endif
+        }
+    }
+
+    // level 0 is the depth buffer itself, every next level halves it keeping the farthest depth
+    void buildPyramid()
+    {
+        pyramid.resize(1);
+        pyramid[0].width = width;
+        pyramid[0].height = height;
+        pyramid[0].depth = depth;
+        while (pyramid.back().width > 1 || pyramid.back().height > 1) {
+            const Level& fine = pyramid.back();
+            Level coarse;
+            coarse.width = max(fine.width / 2, 1u);
+            coarse.height = max(fine.height / 2, 1u);
+            coarse.depth.resize(coarse.width * coarse.height);
+            for (GLuint y = 0; y < coarse.height; ++y)
+                for (GLuint x = 0; x < coarse.width; ++x) {
+                    // odd sizes fold their last row / column into the last texel
+                    GLuint fx1 = x + 1 == coarse.width ? fine.width : 2 * x + 2;
+                    GLuint fy1 = y + 1 == coarse.height ? fine.height : 2 * y + 2;
+                    GLfloat farthest = 0.0f;
+                    for (GLuint fy = 2 * y; fy < fy1; ++fy)
+                        for (GLuint fx = 2 * x; fx < fx1; ++fx)
+                            farthest = max(farthest, fine.depth[fy * fine.width + fx]);
+                    coarse.depth[y * coarse.width + x] = farthest;
+                }
+            pyramid.push_back(std::move(coarse));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// number of threads to use for a job, 0 asks for one per hardware thread
+inline unsigned resolveThreadCount(unsigned threads)
+{
+    if (threads == 0)
+        threads = thread::hardware_concurrency();
+    return max(threads, 1u);
+}
+
+// calls job(i) for every i in [0, count) on up to threads threads, the calling thread takes part.
+// Items are handed out one by one, so uneven items still keep all threads busy. The threads are started for
+// this call, which suits one-off jobs (OBJ parsing, shader setup); per-frame jobs use ThreadPool::parallelFor.
+template <typename F>
+void parallelFor(size_t count, unsigned threads, F job)
+{
+    threads = (unsigned)min<size_t>(resolveThreadCount(threads), count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            job(i);
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (thread& t: pool)
+        t.join();
+}
+
+#endif
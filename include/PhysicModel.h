@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Model.h"
+#include "Profiler.h"
 #include "Shader.h"
 #include "Collision.h"
 
@@ -15,7 +16,7 @@ using namespace std;
 class StaticModel: public Model
 {
 public:
-    StaticModel(string path, GLfloat weight = 1.0f, GLfloat energyCoefficient = 0.8f): Model(path)
+    StaticModel(string path, GLfloat weight = 1.0f, GLfloat energyCoefficient = 0.8f, const ObjLoadOptions& options = ObjLoadOptions()): Model(path, options)
     {
         setParametres(weight, energyCoefficient);
     }
@@ -43,21 +44,28 @@ private:
 class PhysicModel: public Model
 {
 public:
-    PhysicModel(string path, GLfloat weight = 1.0f): Model(path)
+    PhysicModel(string path, GLfloat weight = 1.0f, const ObjLoadOptions& options = ObjLoadOptions()): Model(path, options)
     {
         setParametres(weight);
     }
 
     void PhysicDraw(Shader& shader, GLfloat& delta)
     {
-        setSpeed(delta);
-        setTranslate(this->speed * delta);
+        PhysicUpdate(delta);
         Draw(shader);
         // glm::vec3 centreCol = getCollisionRectangle()[0].getCentre();
         // cout << centreCol.x << " " << centreCol.y << " " << centreCol.z << "\n";
         // cout << speed.x << " " << speed.y << " " << speed.z << "\n";
     }
 
+    // moves the model without drawing it, for models drawn through a RenderQueue
+    void PhysicUpdate(GLfloat& delta)
+    {
+        PROFILE_ZONE("physics");
+        setSpeed(delta);
+        setTranslate(this->speed * delta);
+    }
+
     void setBoost(glm::vec3 strenght)
     {
         this->boost += strenght / this->weight;
@@ -70,6 +78,7 @@ public:
 
     void setBoostWithCollisionRectangle(StaticModel& other)
     {
+        PROFILE_ZONE("collision");
         glm::vec3 strenght(0.0f);
         vector<CollisionRectangle> collisions = other.getCollisionRectangle();
         vector<CollisionRectangle> my_collisions = getCollisionRectangle();
@@ -94,6 +103,7 @@ public:
 
     void setBoostWithCollisionRectangle(PhysicModel& other)
     {
+        PROFILE_ZONE("collision");
         glm::vec3 strenght(0.0f);
         vector<CollisionRectangle> collisions = other.getCollisionRectangle();
         vector<CollisionRectangle> my_collisions = getCollisionRectangle();
@@ -117,6 +127,7 @@ public:
 
     void setBoostWithCollisionRectangleSphere(StaticModel& other)
     {
+        PROFILE_ZONE("collision");
         glm::vec3 strenght(0.0f);
         vector<CollisionSphere> collisions = other.getCollisionSphere();
         vector<CollisionRectangle> my_collisions = getCollisionRectangle();
@@ -137,6 +148,7 @@ public:
 
     void setBoostWithCollisionSphere(StaticModel& other)
     {
+        PROFILE_ZONE("collision");
         glm::vec3 strenght(0.0f);
         vector<CollisionSphere> otherCollisions = other.getCollisionSphere();
         vector<CollisionSphere> myCollisions = getCollisionSphere();
@@ -8,6 +8,7 @@
 
 #include "Camera.h"
 #include "PhysicModel.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -26,10 +27,17 @@ public:
 
     void playerDraw(Shader& shader, GLfloat deltaTime)
     {
+        playerUpdate(deltaTime);
+        Draw(shader);
+    }
+
+    // moves the player without drawing it, for players drawn through a RenderQueue
+    void playerUpdate(GLfloat deltaTime)
+    {
+        PROFILE_ZONE("physics");
         setSpeed(deltaTime);
         cout << getSpeed().x << " " << getSpeed().y << " " << getSpeed().z << "\n";
         setTranslate(getSpeed() * deltaTime);
-        Draw(shader);
     }
 
     void setTranslate(glm::vec3 a)
@@ -80,6 +88,11 @@ public:
         return this->camera.GetViewMatrix();
     }
 
+    Frustum getCameraFrustum(const glm::mat4& projection)
+    {
+        return this->camera.GetFrustum(projection);
+    }
+
 private:
     Camera camera;
     GLfloat movementSpeed;
@@ -0,0 +1,452 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// PROFILER_ENABLED 1 records the PROFILE_* zones, 0 compiles them out. Off by default in release (NDEBUG) builds.
+#ifndef PROFILER_ENABLED
+#ifdef NDEBUG
+#define PROFILER_ENABLED 0
+#else
+#define PROFILER_ENABLED 1
+#endif
+#endif
+
+// one finished zone: name is a string literal, the times are nanoseconds since the profiler started
+struct ProfileEvent {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+    // the track (thread or GPU) it was recorded on
+    uint32_t track;
+};
+
+// Fixed size queue of events between one producer (the thread of a track) and one consumer (Profiler::collect).
+// Neither side locks or waits: a push into a full ring drops the event and counts it.
+class ProfileRing
+{
+public:
+    static const size_t CAPACITY = 1 << 13;
+
+    bool push(const ProfileEvent& event)
+    {
+        size_t head = this->head.load(memory_order_relaxed);
+        if (head - tail.load(memory_order_acquire) == CAPACITY) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        events[head % CAPACITY] = event;
+        this->head.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    // appends the events pushed so far to out, returns how many
+    size_t drain(deque<ProfileEvent>& out)
+    {
+        size_t tail = this->tail.load(memory_order_relaxed);
+        size_t head = this->head.load(memory_order_acquire);
+        for (size_t i = tail; i != head; ++i)
+            out.push_back(events[i % CAPACITY]);
+        this->tail.store(head, memory_order_release);
+        return head - tail;
+    }
+
+    size_t getDropped() const
+    {
+        return dropped.load(memory_order_relaxed);
+    }
+
+private:
+    ProfileEvent events[CAPACITY];
+    atomic<size_t> head{0}, tail{0}, dropped{0};
+};
+
+// a timeline of the trace, the zones of one thread or the GPU timings of one context
+struct ProfileTrack {
+    uint32_t id;
+    string name;
+    ProfileRing ring;
+};
+
+// Collects the zones of every thread for a Chrome trace (chrome://tracing, ui.perfetto.dev).
+// A thread gets its own track, and with it its own ring, the first time it records; recording is lock-free from
+// then on. collect, called regularly from one thread (e.g. once per frame), moves the rings into the history,
+// which keeps the newest events. Use the one of the process, profiler().
+class Profiler
+{
+public:
+    Profiler()
+    {
+        epoch = chrono::steady_clock::now();
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator =(const Profiler&) = delete;
+
+    // nanoseconds since the profiler started
+    uint64_t now() const
+    {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    // nanoseconds on the steady clock at which the profiler started, to move other clocks onto its timeline
+    int64_t getEpoch() const
+    {
+        return (int64_t)chrono::duration_cast<chrono::nanoseconds>(epoch.time_since_epoch()).count();
+    }
+
+    // the track of the calling thread, created on its first call. Threads keep their track for the life of the
+    // process, so zones belong in long lived threads, not in short jobs that start a thread each
+    ProfileTrack& threadTrack()
+    {
+        thread_local ProfileTrack* track = nullptr;
+        if (track == nullptr)
+            track = &addTrack("thread");
+        return *track;
+    }
+
+    // names the calling thread in the trace
+    void setThreadName(const char* name)
+    {
+        ProfileTrack& track = threadTrack();
+        lock_guard<mutex> lock(this->lock);
+        track.name = name;
+    }
+
+    // a new track, e.g. for the GPU timings of a context; its events have to come from one thread
+    ProfileTrack& addTrack(const string& name)
+    {
+        lock_guard<mutex> lock(this->lock);
+        tracks.emplace_back(new ProfileTrack());
+        ProfileTrack& track = *tracks.back();
+        track.id = (uint32_t)tracks.size() - 1;
+        track.name = track.id == 0 || name != "thread" ? name : name + " " + to_string(track.id);
+        return track;
+    }
+
+    void record(ProfileTrack& track, const char* name, uint64_t begin, uint64_t end)
+    {
+        track.ring.push(ProfileEvent{name, begin, end, track.id});
+    }
+
+    // moves the recorded events into the history, dropping the oldest ones past the history limit
+    void collect()
+    {
+        lock_guard<mutex> lock(this->lock);
+        for (unique_ptr<ProfileTrack>& track: tracks)
+            track->ring.drain(history);
+        while (history.size() > historyLimit)
+            history.pop_front();
+    }
+
+    // forgets every event recorded so far
+    void clear()
+    {
+        collect();
+        lock_guard<mutex> lock(this->lock);
+        history.clear();
+    }
+
+    void setHistoryLimit(size_t events)
+    {
+        lock_guard<mutex> lock(this->lock);
+        historyLimit = events;
+    }
+
+    // the collected events, in the order their tracks recorded them
+    vector<ProfileEvent> getEvents()
+    {
+        lock_guard<mutex> lock(this->lock);
+        return vector<ProfileEvent>(history.begin(), history.end());
+    }
+
+    string getTrackName(uint32_t id)
+    {
+        lock_guard<mutex> lock(this->lock);
+        return id < tracks.size() ? tracks[id]->name : string();
+    }
+
+    // events lost to full rings
+    size_t getDropped()
+    {
+        lock_guard<mutex> lock(this->lock);
+        size_t dropped = 0;
+        for (unique_ptr<ProfileTrack>& track: tracks)
+            dropped += track->ring.getDropped();
+        return dropped;
+    }
+
+    // collects, then writes the history as Chrome trace JSON
+    void writeChromeTrace(ostream& out)
+    {
+        collect();
+        lock_guard<mutex> lock(this->lock);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (unique_ptr<ProfileTrack>& track: tracks) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->id
+                << ",\"args\":{\"name\":\"" << escape(track->name) << "\"}}";
+            first = false;
+        }
+        out << fixed << setprecision(3);
+        for (const ProfileEvent& event: history) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << escape(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+                << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+    }
+
+    // returns false when path cannot be written
+    bool exportChromeTrace(const string& path)
+    {
+        ofstream file(path);
+        if (!file) {
+            cout << "ERROR::PROFILER::TRACE_NOT_SUCCESFULLY_WRITTEN: " << path << endl;
+            return false;
+        }
+        writeChromeTrace(file);
+        return true;
+    }
+
+private:
+    chrono::steady_clock::time_point epoch;
+    // tracks are only added, so the ones threads hold stay valid
+    vector<unique_ptr<ProfileTrack>> tracks;
+    deque<ProfileEvent> history;
+    size_t historyLimit = 1 << 18;
+    mutex lock;
+
+    static string escape(const string& text)
+    {
+        string escaped;
+        for (char c: text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char)c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+inline Profiler& profiler()
+{
+    static Profiler instance;
+    return instance;
+}
+
+// times its scope on the track of the calling thread
+class ProfileZone
+{
+public:
+    ProfileZone(const char* name)
+    {
+        this->name = name;
+        this->begin = profiler().now();
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator =(const ProfileZone&) = delete;
+
+    ~ProfileZone()
+    {
+        Profiler& profiler = ::profiler();
+        profiler.record(profiler.threadTrack(), name, begin, profiler.now());
+    }
+
+private:
+    const char* name;
+    uint64_t begin;
+};
+
+// GPU timings of zones, measured with GL timestamp queries. A zone's queries are read FRAMES frames after it was
+// recorded, when the GPU is long done with them, so reading never stalls; zones whose results are still not there
+// by then are skipped. The timestamps are moved onto the profiler's clock and recorded on a track of their own.
+// Everything runs on the GL thread: beginFrame once per frame, begin / end around the GPU work.
+class GpuProfiler
+{
+public:
+    // frames between a zone and the reading of its queries
+    static const size_t FRAMES = 4;
+
+    GpuProfiler(const string& name = "GPU")
+    {
+        this->name = name;
+    }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator =(const GpuProfiler&) = delete;
+
+    // records the zones of the frame FRAMES frames ago and starts a new one in its queries
+    void beginFrame()
+    {
+        if (track == nullptr)
+            return;
+        ++frame;
+        Frame& current = frames[frame % FRAMES];
+        resolve(current);
+        current.zones.clear();
+        current.used = 0;
+        // the GPU clock may drift from the CPU one, measure their offset now and then
+        if (frame % 256 == 1)
+            calibrate();
+    }
+
+    // starts a zone, returns what end takes
+    size_t begin(const char* name)
+    {
+        if (track == nullptr) {
+            track = &profiler().addTrack(this->name);
+            calibrate();
+        }
+        Frame& current = frames[frame % FRAMES];
+        if (current.used + 2 > current.queries.size()) {
+            size_t size = current.queries.size();
+            current.queries.resize(max<size_t>(16, size * 2));
+            glGenQueries((GLsizei)(current.queries.size() - size), current.queries.data() + size);
+        }
+        current.zones.push_back(Zone{name, current.used, false});
+        glQueryCounter(current.queries[current.used], GL_TIMESTAMP);
+        current.used += 2;
+        return current.zones.size() - 1;
+    }
+
+    void end(size_t zone)
+    {
+        Frame& current = frames[frame % FRAMES];
+        current.zones[zone].ended = true;
+        glQueryCounter(current.queries[current.zones[zone].query + 1], GL_TIMESTAMP);
+    }
+
+    // zones recorded on the track, and zones dropped because their results were not there in time
+    size_t getResolved() const
+    {
+        return this->resolved;
+    }
+
+    size_t getSkipped() const
+    {
+        return this->skipped;
+    }
+
+    // deletes the queries, call on the GL thread while the context is alive
+    void release()
+    {
+        for (Frame& frame: frames) {
+            if (!frame.queries.empty())
+                glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+            frame.queries.clear();
+            frame.zones.clear();
+            frame.used = 0;
+        }
+    }
+
+private:
+    struct Zone {
+        const char* name;
+        // the begin query, the end query follows it
+        size_t query;
+        bool ended;
+    };
+
+    struct Frame {
+        vector<GLuint> queries;
+        vector<Zone> zones;
+        size_t used = 0;
+    };
+
+    string name;
+    ProfileTrack* track = nullptr;
+    Frame frames[FRAMES];
+    size_t frame = 0;
+    // profiler time minus GPU time, in nanoseconds
+    int64_t offset = 0;
+    size_t resolved = 0, skipped = 0;
+
+    void calibrate()
+    {
+        GLint64 gpu = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu);
+        offset = (int64_t)profiler().now() - (int64_t)gpu;
+    }
+
+    void resolve(Frame& frame)
+    {
+        if (frame.zones.empty())
+            return;
+        // queries finish in order, so the last one being there means all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            skipped += frame.zones.size();
+            return;
+        }
+        for (const Zone& zone: frame.zones) {
+            if (!zone.ended) {
+                ++skipped;
+                continue;
+            }
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[zone.query], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[zone.query + 1], GL_QUERY_RESULT, &end);
+            int64_t first = max<int64_t>((int64_t)begin + offset, 0);
+            int64_t last = max<int64_t>((int64_t)end + offset, first);
+            profiler().record(*track, zone.name, (uint64_t)first, (uint64_t)last);
+            ++resolved;
+        }
+    }
+};
+
+// times its scope on the GPU
+class GpuProfileZone
+{
+public:
+    GpuProfileZone(GpuProfiler& gpu, const char* name): gpu(gpu)
+    {
+        this->zone = gpu.begin(name);
+    }
+
+    GpuProfileZone(const GpuProfileZone&) = delete;
+    GpuProfileZone& operator =(const GpuProfileZone&) = delete;
+
+    ~GpuProfileZone()
+    {
+        gpu.end(zone);
+    }
+
+private:
+    GpuProfiler& gpu;
+    size_t zone;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// PROFILE_ZONE("name") times the rest of the scope on the CPU, PROFILE_GPU_ZONE(gpuProfiler, "name") on the GPU,
+// PROFILE_THREAD("name") names the calling thread; the names have to be string literals
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(gpu, name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(gpu, name)
+#define PROFILE_THREAD(name) profiler().setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(gpu, name) ((void)(gpu))
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,389 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "IndirectDraw.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Sorts values by keys (both reordered), least significant byte first. Passes over a byte every key shares are skipped,
+// so keys that only use their high bits cost a few passes. Stable, like every LSD radix sort.
+inline void radixSort(vector<uint64_t>& keys, vector<uint32_t>& values)
+{
+    size_t count = keys.size();
+    vector<uint64_t> keyBuffer(count);
+    vector<uint32_t> valueBuffer(count);
+
+    for (GLuint shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (uint64_t key: keys)
+            ++histogram[(key >> shift) & 0xFF];
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (size_t& bucket: histogram) {
+            size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t to = histogram[(keys[i] >> shift) & 0xFF]++;
+            keyBuffer[to] = keys[i];
+            valueBuffer[to] = values[i];
+        }
+        keys.swap(keyBuffer);
+        values.swap(valueBuffer);
+    }
+}
+
+// what a RenderQueue flush did, and the binds and uniform uploads it did not have to do
+struct RenderQueueStats {
+    size_t items = 0;
+    // items dropped by frustum / occlusion culling, not counted in items
+    size_t culled = 0, occluded = 0;
+    // API draw calls, one per item unless the multi-draw-indirect path merged them
+    size_t drawCalls = 0;
+    size_t programBinds = 0, materialBinds = 0, vertexArrayBinds = 0, meshBinds = 0;
+    // binds skipped because the previous item had the same program / material / VAO / mesh
+    size_t savedBinds = 0;
+    // uniform uploads the shaders skipped because the value was already set
+    size_t savedUploads = 0;
+};
+
+// Collects the draws of a frame and submits them sorted by a 64-bit key, so items sharing a program, material
+// and mesh follow each other and only the first of them sets that state.
+// Key layout, most significant first: program (8 bits), material (16), VAO (16), depth (24, front to back).
+// Meshes share the VAO of their geometry arena, so a frame mostly binds one VAO per layout and program.
+// With setIndirect, each run of items sharing a program and VAO is a single glMultiDrawElementsIndirect instead,
+// the shader fetching the transforms and material of each draw from buffer textures (see IndirectDraw.h);
+// materials cost nothing there, so the VAO goes before the material in the key.
+class RenderQueue
+{
+public:
+    // switches to the multi-draw-indirect path, only when loadMultiDrawIndirect said it is there
+    void setIndirect(bool indirect)
+    {
+        this->indirect = indirect;
+    }
+
+    bool getIndirect() const
+    {
+        return this->indirect;
+    }
+
+    // drops the items outside frustum in every flush from now on, set it again each frame as the camera moves
+    void setFrustum(const Frustum& frustum)
+    {
+        this->frustum = frustum;
+        this->culling = true;
+    }
+
+    // also drops the items hidden behind the occluders of occlusion, which has to be finished before flush;
+    // nullptr turns it off. Only used together with a frustum
+    void setOcclusion(OcclusionCuller* occlusion)
+    {
+        this->occlusion = occlusion;
+    }
+
+    // deletes the GL objects of the indirect path, call on the GL thread while the context is alive
+    void release()
+    {
+        indirectBuffers.release();
+    }
+
+    // empties the queue for a new frame, depth is measured from cameraPosition up to farPlane
+    void begin(glm::vec3 cameraPosition, GLfloat farPlane = 100.0f)
+    {
+        this->cameraPosition = cameraPosition;
+        this->farPlane = farPlane;
+        items.clear();
+        keys.clear();
+        programs.clear();
+        // the material ids only have to be stable within a frame, start over before they run out
+        if (materials.size() >= MATERIAL_OVERFLOW) {
+            materials.clear();
+            materialRecords.clear();
+            materialsChanged = true;
+        }
+    }
+
+    // queues one draw of a level of detail of mesh, the mesh has to stay alive until flush
+    void add(Shader& shader, Mesh& mesh, GLuint lod, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        glm::vec3 centre = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+        GLfloat depth = glm::clamp(glm::length(centre - cameraPosition) / farPlane, 0.0f, 1.0f);
+        GLuint material = materialId(mesh);
+
+        uint64_t vertexArray = mesh.VAO & 0xFFFF;
+        uint64_t state = indirect ? vertexArray << 16 | material : (uint64_t)material << 16 | vertexArray;
+        uint64_t key = (uint64_t)programId(shader) << 56 | state << 24 | (uint64_t)(depth * 0xFFFFFF);
+        keys.push_back(key);
+        items.push_back(DrawItem{&shader, &mesh, lod, material, model, normalMatrix});
+    }
+
+    // sorts and draws the queued items
+    void flush()
+    {
+        PROFILE_ZONE("render queue");
+        stats = RenderQueueStats();
+        if (culling)
+            cull();
+        stats.items = items.size();
+
+        order.resize(items.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        radixSort(keys, order);
+
+        size_t skippedBefore = 0;
+        for (Shader* shader: programs)
+            skippedBefore += shader->getSkippedUploads();
+
+        if (indirect)
+            drawIndirect();
+        else
+            drawDirect(order);
+
+        stats.savedBinds = 4 * stats.items - stats.programBinds - stats.materialBinds - stats.vertexArrayBinds - stats.meshBinds;
+        for (Shader* shader: programs)
+            stats.savedUploads += shader->getSkippedUploads();
+        stats.savedUploads -= skippedBefore;
+
+        items.clear();
+        keys.clear();
+    }
+
+    const RenderQueueStats& getStats() const
+    {
+        return this->stats;
+    }
+
+private:
+    static constexpr UniformName MODEL = UniformName("model");
+    static constexpr UniformName NORMAL_MATRIX = UniformName("normalMatrix");
+    static constexpr UniformName INDIRECT = UniformName("indirect");
+    // shared by the materials beyond the 16 bits of the key, items with it always set their material
+    static const GLuint MATERIAL_OVERFLOW = 0xFFFF;
+
+    struct DrawItem {
+        Shader* shader;
+        Mesh* mesh;
+        GLuint lod;
+        GLuint material;
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+    };
+
+    // consecutive commands drawn by one glMultiDrawElementsIndirect
+    struct IndirectRun {
+        Shader* shader;
+        Mesh* mesh;
+        size_t firstCommand;
+        size_t commandCount;
+    };
+
+    vector<DrawItem> items;
+    vector<uint64_t> keys;
+    vector<uint32_t> order;
+    // the programs of this frame, their index is the program part of the key
+    vector<Shader*> programs;
+    // distinct material values seen so far, their index is the material part of the key
+    map<array<GLfloat, 10>, GLuint> materials;
+    // the same materials by index, the material table of the indirect path
+    vector<MaterialRecord> materialRecords;
+    bool materialsChanged = false;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    GLfloat farPlane = 100.0f;
+    RenderQueueStats stats;
+
+    bool culling = false;
+    Frustum frustum;
+    FrustumCuller culler;
+    OcclusionCuller* occlusion = nullptr;
+
+    bool indirect = false;
+    IndirectDrawBuffers indirectBuffers;
+    vector<DrawElementsIndirectCommand> commands;
+    vector<DrawRecord> records;
+    vector<IndirectRun> runs;
+    // items the indirect path leaves to drawDirect
+    vector<uint32_t> directItems;
+
+    // tests the bounds of every item against the frustum in one batched pass, then the ones inside against the
+    // occluders, and keeps the visible items (and keys)
+    void cull()
+    {
+        culler.clear();
+        for (const DrawItem& item: items)
+            culler.add(item.mesh->boundsMin, item.mesh->boundsMax, item.model);
+        const vector<uint32_t>& visible = culler.cull(frustum);
+        stats.culled = items.size() - visible.size();
+        // visible is ascending, so moving the items to the front never overwrites one still to be moved
+        size_t kept = 0;
+        for (uint32_t i: visible) {
+            const DrawItem& item = items[i];
+            if (occlusion != nullptr && !occlusion->visible(item.mesh->boundsMin, item.mesh->boundsMax, item.model)) {
+                ++stats.occluded;
+                continue;
+            }
+            items[kept] = items[i];
+            keys[kept] = keys[i];
+            ++kept;
+        }
+        items.resize(kept);
+        keys.resize(kept);
+    }
+
+    // one glDrawElementsBaseVertex per item, in the given order, setting only the state that changed
+    void drawDirect(const vector<uint32_t>& sequence)
+    {
+        Shader* shader = nullptr;
+        GLuint material = 0xFFFFFFFFu;
+        GLuint vertexArray = 0;
+        Mesh* mesh = nullptr;
+        for (uint32_t i: sequence) {
+            const DrawItem& item = items[i];
+            if (item.shader != shader) {
+                shader = item.shader;
+                shader->use();
+                ++stats.programBinds;
+                // the material and mesh uniforms are per program
+                material = 0xFFFFFFFFu;
+                mesh = nullptr;
+            }
+            if (item.mesh->VAO != vertexArray) {
+                vertexArray = item.mesh->VAO;
+                item.mesh->bindVertexArray();
+                ++stats.vertexArrayBinds;
+            }
+            if (item.material != material || material == MATERIAL_OVERFLOW) {
+                material = item.material;
+                item.mesh->applyMaterial(*shader);
+                ++stats.materialBinds;
+            }
+            if (item.mesh != mesh) {
+                mesh = item.mesh;
+                mesh->bindUniforms(*shader);
+                ++stats.meshBinds;
+            }
+
+            shader->setMat4(MODEL, item.model);
+            shader->setMat3(NORMAL_MATRIX, item.normalMatrix);
+            mesh->drawElements(item.lod);
+            ++stats.drawCalls;
+        }
+        glBindVertexArray(0);
+    }
+
+    // one glMultiDrawElementsIndirect per run of sorted items sharing a program and VAO; items with an overflowed
+    // material, or beyond what the record texture holds, are drawn by drawDirect after them
+    void drawIndirect()
+    {
+        size_t maxDraws = indirectBuffers.getMaxDraws();
+        commands.clear();
+        records.clear();
+        runs.clear();
+        directItems.clear();
+        for (uint32_t i: order) {
+            const DrawItem& item = items[i];
+            if (item.material == MATERIAL_OVERFLOW || records.size() >= maxDraws) {
+                directItems.push_back(i);
+                continue;
+            }
+            if (runs.empty() || runs.back().shader != item.shader || runs.back().mesh->VAO != item.mesh->VAO)
+                runs.push_back(IndirectRun{item.shader, item.mesh, commands.size(), 0});
+            ++runs.back().commandCount;
+
+            DrawElementsIndirectCommand command = item.mesh->indirectCommand(item.lod);
+            command.baseInstance = (GLuint)records.size();
+            commands.push_back(command);
+            records.push_back(drawRecord(item));
+        }
+
+        if (!commands.empty()) {
+            indirectBuffers.upload(commands, records, materialRecords, materialsChanged);
+            materialsChanged = false;
+            indirectBuffers.bind();
+            Shader* shader = nullptr;
+            for (const IndirectRun& run: runs) {
+                if (run.shader != shader) {
+                    shader = run.shader;
+                    shader->use();
+                    ++stats.programBinds;
+                    // reset by the next plain draw of a mesh (see Mesh::bindUniforms)
+                    shader->setFloat(INDIRECT, 1.0f);
+                }
+                run.mesh->bindVertexArray();
+                ++stats.vertexArrayBinds;
+                indirectBuffers.enableDrawIndex();
+                glMultiDrawElementsIndirect(GL_TRIANGLES, run.mesh->indexType,
+                    (void*)(run.firstCommand * sizeof(DrawElementsIndirectCommand)), (GLsizei)run.commandCount, 0);
+                indirectBuffers.disableDrawIndex();
+                ++stats.drawCalls;
+            }
+            glBindVertexArray(0);
+            indirectBuffers.unbind();
+        }
+
+        drawDirect(directItems);
+    }
+
+    DrawRecord drawRecord(const DrawItem& item) const
+    {
+        DrawRecord record;
+        for (GLuint c = 0; c < 4; ++c)
+            record.model[c] = item.model[c];
+        for (GLuint c = 0; c < 3; ++c)
+            record.normalMatrix[c] = glm::vec4(item.normalMatrix[c], 0.0f);
+        record.positionScale = glm::vec4(item.mesh->positionScale(), (GLfloat)item.material);
+        record.positionOffset = glm::vec4(item.mesh->positionOffset(), 0.0f);
+        return record;
+    }
+
+    GLuint programId(Shader& shader)
+    {
+        auto it = find(programs.begin(), programs.end(), &shader);
+        if (it == programs.end()) {
+            programs.push_back(&shader);
+            it = programs.end() - 1;
+        }
+        return (GLuint)min<size_t>(it - programs.begin(), 0xFF);
+    }
+
+    GLuint materialId(const Mesh& mesh)
+    {
+        const Material& material = mesh.material;
+        array<GLfloat, 10> value;
+        memcpy(value.data(), &material.Ambient[0], 3 * sizeof(GLfloat));
+        memcpy(value.data() + 3, &material.Diffuse[0], 3 * sizeof(GLfloat));
+        memcpy(value.data() + 6, &material.Specular[0], 3 * sizeof(GLfloat));
+        value[9] = material.Shininess;
+        auto it = materials.find(value);
+        if (it != materials.end())
+            return it->second;
+        if (materials.size() >= MATERIAL_OVERFLOW)
+            return MATERIAL_OVERFLOW;
+        materialRecords.push_back(mesh.materialRecord());
+        materialsChanged = true;
+        return materials.emplace(value, (GLuint)materials.size()).first->second;
+    }
+};
+
+#endif
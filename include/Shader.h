@@ -2,6 +2,11 @@
 #define SHADER_H
 
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -13,6 +18,53 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// uniform buffer binding point of the per-frame block FrameData (see FrameUniforms.h),
+// Shader connects the block of every program to it
+const GLuint FRAME_DATA_BINDING = 0;
+
+// texture units of the buffer textures the multi-draw-indirect path reads per-draw data from (see IndirectDraw.h),
+// Shader points the samplers drawRecords and materialTable of every program at them
+const GLuint DRAW_RECORDS_UNIT = 14;
+const GLuint MATERIAL_TABLE_UNIT = 15;
+// texture units of the buffer textures of clustered lighting (see ClusteredLights.h), set up the same way
+// for the samplers lightData, lightGrid and lightIndices
+const GLuint LIGHT_DATA_UNIT = 11;
+const GLuint LIGHT_GRID_UNIT = 12;
+const GLuint LIGHT_INDICES_UNIT = 13;
+
+// FNV-1a hash of a uniform name, evaluated at compile time for literals
+constexpr uint32_t uniformHash(const GLchar* name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; ++name)
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    return hash;
+}
+
+// A uniform name with its hash. Declare hot ones as constexpr constants, e.g.
+// constexpr UniformName MODEL("model"), so no hashing is left for run time.
+struct UniformName {
+    const GLchar* text;
+    uint32_t hash;
+
+    constexpr UniformName(const GLchar* text) : text(text), hash(uniformHash(text)) {}
+};
+
+// a slot in the uniform table of one Shader, invalid for names the program does not use
+struct UniformHandle {
+    GLint slot = -1;
+
+    bool valid() const
+    {
+        return slot >= 0;
+    }
+};
+
+// the handles of the uniforms Mesh sets on every draw, looked up once per program when it is linked
+struct MeshUniforms {
+    UniformHandle ambient, diffuse, specular, shininess, positionScale, positionOffset, instanced, indirect;
+};
+
 class Shader
 {
 public:
@@ -97,32 +149,214 @@ public:
         // Удаляем шейдеры, поскольку они уже в программу и нам больше не нужны.
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        reflect();
+    }
+    // wraps a program linked elsewhere (see ShaderLibrary.h), it stays the owner's to delete
+    Shader(GLuint program)
+    {
+        this->Program = program;
+        reflect();
     }
     // Использование программы
     void use() { glUseProgram(this->Program); }
 
-    void setFloat(const GLchar* name, GLfloat x)
+    // the handle of an active uniform, looked up in the table built at link time without asking the driver
+    UniformHandle uniform(UniformName name) const
+    {
+        auto it = std::lower_bound(slots.begin(), slots.end(), std::make_pair(name.hash, (GLint)-1));
+        for (; it != slots.end() && it->first == name.hash; ++it)
+            if (uniforms[it->second].name == name.text)
+                return UniformHandle{it->second};
+        return UniformHandle();
+    }
+
+    const MeshUniforms& meshUniforms() const
+    {
+        return this->meshHandles;
+    }
+
+    // the index of an active uniform block (for glUniformBlockBinding), GL_INVALID_INDEX if there is none
+    GLuint uniformBlock(UniformName name) const
+    {
+        for (const UniformBlock& block: blocks)
+            if (block.name == name.text)
+                return block.index;
+        return GL_INVALID_INDEX;
+    }
+
+    // the setters only reach the driver when the value differs from the last one set through this Shader,
+    // they expect the program to be in use (see use())
+    void setFloat(UniformHandle handle, GLfloat x)
+    {
+        if (changed(handle, &x, 1))
+            glUniform1f(uniforms[handle.slot].location, x);
+    }
+
+    void setVec3(UniformHandle handle, glm::vec3 vectr)
+    {
+        if (changed(handle, glm::value_ptr(vectr), 3))
+            glUniform3f(uniforms[handle.slot].location, vectr.x, vectr.y, vectr.z);
+    }
+
+    void setMat3(UniformHandle handle, const glm::mat3& mat)
+    {
+        if (changed(handle, glm::value_ptr(mat), 9))
+            glUniformMatrix3fv(uniforms[handle.slot].location, 1, GL_FALSE, glm::value_ptr(mat));
+    }
+
+    void setMat4(UniformHandle handle, const glm::mat4& mat)
+    {
+        if (changed(handle, glm::value_ptr(mat), 16))
+            glUniformMatrix4fv(uniforms[handle.slot].location, 1, GL_FALSE, glm::value_ptr(mat));
+    }
+
+    void setFloat(UniformName name, GLfloat x)
     {
-        GLint location = glGetUniformLocation(this->Program, name);
-        glUniform1f(location, x);
+        setFloat(uniform(name), x);
     }
 
-    void setVec3(const GLchar* name, glm::vec3 vectr)
+    void setVec3(UniformName name, glm::vec3 vectr)
     {
-        GLint location = glGetUniformLocation(this->Program, name);
-        glUniform3f(location, vectr.x, vectr.y, vectr.z);
+        setVec3(uniform(name), vectr);
     }
 
-    void setVec3(const GLchar* name, GLfloat x, GLfloat y, GLfloat z)
+    void setVec3(UniformName name, GLfloat x, GLfloat y, GLfloat z)
     {
-        GLint location = glGetUniformLocation(this->Program, name);
-        glUniform3f(location, x, y, z);
+        setVec3(uniform(name), glm::vec3(x, y, z));
     }
 
-    void setMat4(const GLchar* name, glm::mat4 mat)
+    void setMat3(UniformName name, const glm::mat3& mat)
     {
-        GLint location = glGetUniformLocation(this->Program, name);
-        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+        setMat3(uniform(name), mat);
+    }
+
+    void setMat4(UniformName name, const glm::mat4& mat)
+    {
+        setMat4(uniform(name), mat);
+    }
+
+    // uniform uploads sent to the driver / skipped because the value was already set
+    size_t getUniformUploads() const
+    {
+        return this->uploads;
+    }
+
+    size_t getSkippedUploads() const
+    {
+        return this->skipped;
+    }
+
+private:
+    struct Uniform {
+        std::string name;
+        GLint location;
+        GLenum type;
+        // the last value uploaded, valid once set is true
+        GLfloat value[16];
+        bool set = false;
+    };
+
+    struct UniformBlock {
+        std::string name;
+        GLuint index;
+        GLint dataSize;
+    };
+
+    std::vector<Uniform> uniforms;
+    // (name hash, index into uniforms), sorted for lookup
+    std::vector<std::pair<uint32_t, GLint>> slots;
+    std::vector<UniformBlock> blocks;
+    MeshUniforms meshHandles;
+    size_t uploads = 0, skipped = 0;
+
+    // enumerates the active uniforms (those outside blocks get a location) and uniform blocks of the linked program
+    void reflect()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->Program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            GLint location = glGetUniformLocation(this->Program, buffer.data());
+            // members of uniform blocks have no location, they are set through the block buffer
+            if (location < 0)
+                continue;
+
+            Uniform uniform;
+            uniform.name.assign(buffer.data(), length);
+            // arrays are reported as "name[0]", the first element is also reachable as "name"
+            if (size > 1 && uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+                uniform.name.resize(uniform.name.size() - 3);
+            uniform.location = location;
+            uniform.type = type;
+            slots.push_back(std::make_pair(uniformHash(uniform.name.c_str()), (GLint)uniforms.size()));
+            uniforms.push_back(uniform);
+        }
+        std::sort(slots.begin(), slots.end());
+
+        meshHandles.ambient = uniform("material.ambient");
+        meshHandles.diffuse = uniform("material.diffuse");
+        meshHandles.specular = uniform("material.specular");
+        meshHandles.shininess = uniform("material.shininess");
+        meshHandles.positionScale = uniform("positionScale");
+        meshHandles.positionOffset = uniform("positionOffset");
+        meshHandles.instanced = uniform("instanced");
+        meshHandles.indirect = uniform("indirect");
+
+        GLint blockCount = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        for (GLint i = 0; i < blockCount; ++i) {
+            GLint length = 0;
+            glGetActiveUniformBlockiv(this->Program, (GLuint)i, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+            std::vector<GLchar> name(std::max(length, 1));
+            glGetActiveUniformBlockName(this->Program, (GLuint)i, (GLsizei)name.size(), NULL, name.data());
+            UniformBlock block;
+            block.name = name.data();
+            block.index = (GLuint)i;
+            glGetActiveUniformBlockiv(this->Program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            blocks.push_back(block);
+        }
+
+        GLuint frameData = uniformBlock("FrameData");
+        if (frameData != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->Program, frameData, FRAME_DATA_BINDING);
+
+        // the samplers of the engine's buffer textures always read the same unit
+        static const std::pair<const GLchar*, GLuint> samplerUnits[] = {
+            {"drawRecords", DRAW_RECORDS_UNIT}, {"materialTable", MATERIAL_TABLE_UNIT},
+            {"lightData", LIGHT_DATA_UNIT}, {"lightGrid", LIGHT_GRID_UNIT}, {"lightIndices", LIGHT_INDICES_UNIT}
+        };
+        // glUniform needs the program in use, the caller's program is bound again afterwards
+        GLint previous = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(this->Program);
+        for (const auto& sampler: samplerUnits) {
+            UniformHandle handle = uniform(sampler.first);
+            if (handle.valid())
+                glUniform1i(uniforms[handle.slot].location, sampler.second);
+        }
+        glUseProgram((GLuint)previous);
+    }
+
+    // records value as the current one of the uniform, false when it already was (or the handle is invalid)
+    bool changed(UniformHandle handle, const GLfloat* value, size_t count)
+    {
+        if (!handle.valid())
+            return false;
+        Uniform& uniform = uniforms[handle.slot];
+        if (uniform.set && memcmp(uniform.value, value, count * sizeof(GLfloat)) == 0) {
+            ++skipped;
+            return false;
+        }
+        memcpy(uniform.value, value, count * sizeof(GLfloat));
+        uniform.set = true;
+        ++uploads;
+        return true;
     }
 };
 
@@ -0,0 +1,454 @@
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <glad/glad.h>
+
+#include "GraphicsDevice.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace std;
+
+// KHR_parallel_shader_compile is not part of glad's core profile (GL_COMPLETION_STATUS_KHR is in GraphicsDevice.h)
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// Program binary cache file, one per linked program, named after its key (see programCacheKey):
+//     ProgramCacheHeader
+//     the binary glGetProgramBinary returned
+const uint32_t PROGRAM_CACHE_MAGIC = 0x50474E4E; // "NNGP"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t magic, version;
+    uint64_t key;
+    uint32_t format, length;
+};
+
+// the defines of one permutation, "NAME" or "NAME VALUE"
+typedef vector<string> ShaderDefines;
+
+// Whether linked programs can be saved and restored: always on GL 4.1, and on older contexts with
+// ARB_get_program_binary (the entry points have the same names). Drivers may still offer no binary format.
+inline bool loadProgramBinary(GLADloadproc load)
+{
+    if (!GLAD_GL_VERSION_4_1) {
+        if (load == nullptr || !hasGLExtension("GL_ARB_get_program_binary"))
+            return false;
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        if (glad_glGetProgramBinary == NULL || glad_glProgramBinary == NULL || glad_glProgramParameteri == NULL)
+            return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// glMaxShaderCompilerThreadsKHR where the driver has KHR_parallel_shader_compile (or the ARB one), NULL otherwise.
+// With it, compiles and links return at once and run on the driver's threads until their status is asked for.
+inline PFNGLMAXSHADERCOMPILERTHREADSKHRPROC loadParallelShaderCompile(GLADloadproc load)
+{
+    if (load == nullptr)
+        return NULL;
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        return (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        return (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    return NULL;
+}
+
+// source with the defines inserted after its #version line, and a #line so the driver's messages keep the
+// line numbers of the file
+inline string shaderPermutationSource(const string& source, const ShaderDefines& defines)
+{
+    if (defines.empty())
+        return source;
+
+    size_t insert = 0, line = 1;
+    size_t version = source.find("#version");
+    if (version != string::npos) {
+        insert = source.find('\n', version);
+        insert = insert == string::npos ? source.size() : insert + 1;
+        line += (size_t)count(source.begin(), source.begin() + insert, '\n');
+    }
+    string text = source.substr(0, insert);
+    if (!text.empty() && text.back() != '\n')
+        text += '\n';
+    for (const string& define: defines)
+        text += "#define " + define + "\n";
+    text += "#line " + to_string(line) + "\n";
+    return text + source.substr(insert);
+}
+
+// FNV-1a over the final sources and the driver, which is what a program binary depends on: a changed
+// shader or define, or a new driver version, gives a new key
+inline uint64_t programCacheKey(const string& vertexSource, const string& fragmentSource, const string& driver)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const string* text: {&vertexSource, &fragmentSource, &driver}) {
+        for (unsigned char c: *text)
+            hash = (hash ^ c) * 1099511628211ull;
+        // keeps "ab" + "c" apart from "a" + "bc"
+        hash = (hash ^ 0xFF) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline string programCachePath(const string& directory, uint64_t key)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return directory + "/" + name + ".program";
+}
+
+// the binary stored for key, false when there is none or the file is not a cache for key
+inline bool readProgramCache(const string& path, uint64_t key, GLenum& format, vector<char>& binary)
+{
+    ifstream in(path, ios::binary);
+    ProgramCacheHeader header;
+    if (!in.is_open() || !in.read((char*)&header, sizeof(header)))
+        return false;
+    if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key || header.length == 0)
+        return false;
+    binary.resize(header.length);
+    if (!in.read(binary.data(), header.length))
+        return false;
+    format = header.format;
+    return true;
+}
+
+// written next to the cache and renamed, so a reader never gets a half written file
+inline bool writeProgramCache(const string& path, uint64_t key, GLenum format, const vector<char>& binary)
+{
+    error_code error;
+    filesystem::path parent = filesystem::path(path).parent_path();
+    if (!parent.empty())
+        filesystem::create_directories(parent, error);
+
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out.is_open())
+            return false;
+        ProgramCacheHeader header = {PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, format, (uint32_t)binary.size()};
+        out.write((const char*)&header, sizeof(header));
+        out.write(binary.data(), binary.size());
+        if (!out.good()) {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    filesystem::rename(tempPath, path, error);
+    if (error) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// what the library did since it was created
+struct ShaderLibraryStats {
+    // programs restored from the binary cache / compiled from GLSL, and cache files written
+    size_t cacheHits = 0, compiled = 0, cacheWrites = 0;
+    // programs that did not compile or link
+    size_t failed = 0;
+    // wall time of the last begin to finish
+    double milliseconds = 0.0;
+};
+
+// The permutations of one vertex / fragment shader pair: every set of defines is a program of its own, built from
+// the same files. Variants are added, then built together on the GL thread:
+//     begin    restores the ones in the binary cache and issues the compiles and links of the others, all at once,
+//              so with KHR_parallel_shader_compile the driver works on them on its threads
+//     ready    whether the driver is done (always true without the extension), other work can go on meanwhile
+//     finish   waits for them, reports errors, saves the new binaries and makes the Shaders
+// A warm start, with every binary in the cache, compiles no GLSL at all.
+class ShaderLibrary
+{
+public:
+    // load is what the backend was loaded with, for the extensions; an empty cacheDirectory disables the cache
+    ShaderLibrary(const string& vertexPath, const string& fragmentPath, GLADloadproc load, const string& cacheDirectory = "shaders/cache")
+    {
+        this->vertexSource = readSource(vertexPath);
+        this->fragmentSource = readSource(fragmentPath);
+        this->cacheDirectory = cacheDirectory;
+        this->binaries = !cacheDirectory.empty() && loadProgramBinary(load);
+        this->maxCompilerThreads = loadParallelShaderCompile(load);
+        if (maxCompilerThreads != NULL)
+            // let the driver pick the number of threads
+            maxCompilerThreads(0xFFFFFFFF);
+
+        // the driver is part of the cache key, binaries do not survive driver updates
+        for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte* text = glGetString(name);
+            driver += text != NULL ? (const char*)text : "";
+            driver += '\n';
+        }
+    }
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator =(const ShaderLibrary&) = delete;
+
+    // the index of the permutation with defines (in any order), added for the next begin if it is new
+    size_t add(ShaderDefines defines)
+    {
+        sort(defines.begin(), defines.end());
+        defines.erase(unique(defines.begin(), defines.end()), defines.end());
+        for (size_t i = 0; i < variants.size(); ++i)
+            if (variants[i].defines == defines)
+                return i;
+        variants.push_back(Variant());
+        variants.back().defines = std::move(defines);
+        return variants.size() - 1;
+    }
+
+    // starts building the variants added since the last finish
+    void begin()
+    {
+        PROFILE_ZONE("begin shaders");
+        start = chrono::steady_clock::now();
+        building.clear();
+        for (size_t i = 0; i < variants.size(); ++i)
+            if (!variants[i].shader && variants[i].program == 0)
+                building.push_back(i);
+
+        // the sources, keys and cache files, on the CPU
+        parallelFor(building.size(), 0, [&](size_t b) {
+            Variant& variant = variants[building[b]];
+            variant.vertex = shaderPermutationSource(vertexSource, variant.defines);
+            variant.fragment = shaderPermutationSource(fragmentSource, variant.defines);
+            variant.key = programCacheKey(variant.vertex, variant.fragment, driver);
+            variant.cached = binaries && readProgramCache(programCachePath(cacheDirectory, variant.key), variant.key, variant.format, variant.binary);
+        });
+
+        for (size_t i: building) {
+            Variant& variant = variants[i];
+            variant.program = glCreateProgram();
+            if (variant.cached) {
+                glProgramBinary(variant.program, variant.format, variant.binary.data(), (GLsizei)variant.binary.size());
+                GLint success = 0;
+                glGetProgramiv(variant.program, GL_LINK_STATUS, &success);
+                variant.binary.clear();
+                if (success) {
+                    ++stats.cacheHits;
+                    continue;
+                }
+                // the driver turned the binary down (e.g. after an update that kept the version string), compile it
+                glDeleteProgram(variant.program);
+                variant.program = glCreateProgram();
+                variant.cached = false;
+            }
+            // no status is asked for here, so nothing waits for the compiler
+            variant.vertexShader = compile(GL_VERTEX_SHADER, variant.vertex);
+            variant.fragmentShader = compile(GL_FRAGMENT_SHADER, variant.fragment);
+            glAttachShader(variant.program, variant.vertexShader);
+            glAttachShader(variant.program, variant.fragmentShader);
+            if (binaries)
+                glProgramParameteri(variant.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(variant.program);
+            ++stats.compiled;
+        }
+    }
+
+    // whether finish would not wait for the driver
+    bool ready()
+    {
+        if (maxCompilerThreads == NULL)
+            return true;
+        for (size_t i: building) {
+            GLint complete = GL_TRUE;
+            if (!variants[i].cached)
+                glGetProgramiv(variants[i].program, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+                return false;
+        }
+        return true;
+    }
+
+    // completes what begin started, the Shaders of the variants can be used from here on
+    void finish()
+    {
+        PROFILE_ZONE("finish shaders");
+        for (size_t i: building) {
+            Variant& variant = variants[i];
+            if (!variant.cached) {
+                bool linked = check(variant);
+                if (linked && binaries && save(variant))
+                    ++stats.cacheWrites;
+                stats.failed += !linked;
+            }
+            variant.vertex.clear();
+            variant.fragment.clear();
+            variant.shader.reset(new Shader(variant.program));
+        }
+        building.clear();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        stats.milliseconds = elapsed.count();
+    }
+
+    // begin and finish in one go
+    void build()
+    {
+        begin();
+        finish();
+    }
+
+    // the Shader of a variant, once it is built
+    Shader& get(size_t index)
+    {
+        return *variants[index].shader;
+    }
+
+    size_t size() const
+    {
+        return variants.size();
+    }
+
+    const ShaderDefines& getDefines(size_t index) const
+    {
+        return variants[index].defines;
+    }
+
+    // whether linked programs go to / come from the cache directory
+    bool hasBinaryCache() const
+    {
+        return this->binaries;
+    }
+
+    bool hasParallelCompile() const
+    {
+        return this->maxCompilerThreads != NULL;
+    }
+
+    const ShaderLibraryStats& getStats() const
+    {
+        return this->stats;
+    }
+
+    // deletes the programs, call on the GL thread while the context is alive
+    void release()
+    {
+        for (Variant& variant: variants) {
+            if (variant.program != 0)
+                glDeleteProgram(variant.program);
+            variant.program = 0;
+            variant.shader.reset();
+        }
+    }
+
+private:
+    struct Variant {
+        ShaderDefines defines;
+        unique_ptr<Shader> shader;
+        GLuint program = 0;
+        // while it is built
+        string vertex, fragment;
+        uint64_t key = 0;
+        bool cached = false;
+        GLenum format = 0;
+        vector<char> binary;
+        GLuint vertexShader = 0, fragmentShader = 0;
+    };
+
+    string vertexSource, fragmentSource;
+    string cacheDirectory;
+    string driver;
+    bool binaries;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxCompilerThreads;
+    // variants never move once added (Shaders are handed out by reference), so they are kept in a deque
+    deque<Variant> variants;
+    // the variants begin started
+    vector<size_t> building;
+    chrono::steady_clock::time_point start;
+    ShaderLibraryStats stats;
+
+    static string readSource(const string& path)
+    {
+        ifstream file(path);
+        if (!file.is_open()) {
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << endl;
+            return string();
+        }
+        stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+
+    static GLuint compile(GLenum type, const string& source)
+    {
+        GLuint shader = glCreateShader(type);
+        const GLchar* code = source.c_str();
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    // reports the errors of a compiled variant and deletes its shaders, false when it did not link
+    static bool check(Variant& variant)
+    {
+        GLint success;
+        GLchar infoLog[512];
+        string defines;
+        for (const string& define: variant.defines)
+            defines += " " + define;
+        glGetShaderiv(variant.vertexShader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(variant.vertexShader, 512, NULL, infoLog);
+            cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED" << defines << "\n" << infoLog << endl;
+        }
+        glGetShaderiv(variant.fragmentShader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(variant.fragmentShader, 512, NULL, infoLog);
+            cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED" << defines << "\n" << infoLog << endl;
+        }
+        glGetProgramiv(variant.program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(variant.program, 512, NULL, infoLog);
+            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED" << defines << "\n" << infoLog << endl;
+        }
+        glDeleteShader(variant.vertexShader);
+        glDeleteShader(variant.fragmentShader);
+        variant.vertexShader = variant.fragmentShader = 0;
+        return success != 0;
+    }
+
+    bool save(const Variant& variant)
+    {
+        GLint length = 0;
+        glGetProgramiv(variant.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        vector<char> binary((size_t)length);
+        GLenum format = 0;
+        glGetProgramBinary(variant.program, length, &length, &format, binary.data());
+        binary.resize((size_t)max(length, 0));
+        if (binary.empty())
+            return false;
+        string path = programCachePath(cacheDirectory, variant.key);
+        if (!writeProgramCache(path, variant.key, format, binary)) {
+            cout << "ERROR::SHADER::CACHE_NOT_SUCCESFULLY_WRITTEN: " << path << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
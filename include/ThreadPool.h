@@ -0,0 +1,131 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "Parallel.h"
+#include "Profiler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Long lived worker threads running submitted jobs in submission order.
+// The threads are started by the first submit, so an unused pool costs nothing.
+class ThreadPool
+{
+public:
+    // threads: 0 uses one per hardware thread
+    ThreadPool(unsigned threads = 0)
+    {
+        this->threadCount = threads;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator =(const ThreadPool&) = delete;
+
+    // jobs that did not start yet are dropped
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(this->lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker: workers)
+            worker.join();
+    }
+
+    void submit(function<void()> job)
+    {
+        {
+            lock_guard<mutex> lock(this->lock);
+            if (workers.empty())
+                for (unsigned i = 0; i < resolveThreadCount(threadCount); ++i)
+                    workers.emplace_back([this]() { run(); });
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // the same as ::parallelFor(count, threads, job) on the threads of the pool, which are only started once; for
+    // per-frame jobs, where starting threads every call would cost more than the work. Helpers the pool runs late
+    // find the items taken and leave at once, so a busy pool only leaves more of the items to the calling thread
+    template <typename F>
+    void parallelFor(size_t count, unsigned threads, F job)
+    {
+        threads = (unsigned)min<size_t>(min(resolveThreadCount(threads), resolveThreadCount(threadCount) + 1), count);
+        if (threads <= 1) {
+            for (size_t i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+
+        // shared with the helpers, which may outlive this call; job is only called while items are left,
+        // and those keep this call waiting
+        struct Range {
+            atomic<size_t> next{0}, done{0};
+            size_t count;
+            function<void(size_t)> job;
+            mutex lock;
+            condition_variable finished;
+        };
+        shared_ptr<Range> range = make_shared<Range>();
+        range->count = count;
+        range->job = [&job](size_t i) { job(i); };
+        auto worker = [](Range& range) {
+            for (size_t i = range.next++; i < range.count; i = range.next++) {
+                range.job(i);
+                if (++range.done == range.count) {
+                    { lock_guard<mutex> lock(range.lock); }
+                    range.finished.notify_all();
+                }
+            }
+        };
+
+        for (unsigned t = 1; t < threads; ++t)
+            submit([range, worker]() { worker(*range); });
+        worker(*range);
+        unique_lock<mutex> lock(range->lock);
+        range->finished.wait(lock, [&]() { return range->done == count; });
+    }
+
+private:
+    unsigned threadCount;
+    vector<thread> workers;
+    deque<function<void()>> jobs;
+    mutex lock;
+    condition_variable wake;
+    bool stopping = false;
+
+    void run()
+    {
+        PROFILE_THREAD("worker");
+        for (;;) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(this->lock);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// the pool of per-frame jobs (occlusion bands, light slices), apart from the asset loads so a frame never waits behind one
+inline ThreadPool& frameWorkers()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif
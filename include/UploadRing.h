@@ -0,0 +1,305 @@
+#ifndef UPLOADRING_H
+#define UPLOADRING_H
+
+#include <glad/glad.h>
+
+#include "GraphicsDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Hands out aligned ranges of [0, capacity) from the front, one after the other, until reset.
+// allocate can be called from several threads at once.
+class LinearAllocator
+{
+public:
+    static const size_t NONE = (size_t)-1;
+
+    void reset(size_t capacity)
+    {
+        this->capacity = capacity;
+        head.store(0);
+    }
+
+    // the offset of size free elements aligned to alignment (a power of two), NONE when they do not fit
+    size_t allocate(size_t size, size_t alignment)
+    {
+        size_t current = head.load(memory_order_relaxed);
+        for (;;) {
+            size_t offset = (current + alignment - 1) & ~(alignment - 1);
+            if (offset + size > capacity)
+                return NONE;
+            if (head.compare_exchange_weak(current, offset + size, memory_order_relaxed))
+                return offset;
+        }
+    }
+
+    // the end of the last range handed out
+    size_t used() const
+    {
+        return min(head.load(memory_order_relaxed), capacity);
+    }
+
+    size_t getCapacity() const
+    {
+        return this->capacity;
+    }
+
+private:
+    size_t capacity = 0;
+    atomic<size_t> head{0};
+};
+
+// Whether glBufferStorage can be used: always on GL 4.4, and on older contexts with ARB_buffer_storage.
+inline bool loadBufferStorage(GLADloadproc load)
+{
+    if (GLAD_GL_VERSION_4_4)
+        return true;
+    if (!hasGLExtension("GL_ARB_buffer_storage"))
+        return false;
+    glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    return glad_glBufferStorage != NULL;
+}
+
+// a range of the ring for this frame: write size bytes at data, the GPU reads them at offset of the ring buffer
+struct UploadRange {
+    void* data = nullptr;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+};
+
+// what the ring did since it was created
+struct UploadRingStats {
+    size_t frames = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+    // allocations that did not fit in their frame's region (the caller uploads them its own way)
+    size_t overflows = 0;
+    // begins that had to wait for the GPU to finish with a region, and region size increases
+    size_t waits = 0;
+    size_t growths = 0;
+};
+
+// One buffer for the data streamed to the GPU every frame (instances, uniform blocks, ...), split into regions,
+// one per frame in flight. A frame sub-allocates from its region, the region is fenced after the frame's draws
+// and only written again once the GPU has passed that fence, so uploads neither stall nor orphan.
+// With buffer storage the buffer is mapped once, persistent and coherent, and writes go straight to it; on plain
+// GL 3.3 they go to a CPU copy of the region that flush sends with an unsynchronized map, the fences doing the
+// synchronization the driver skips.
+// Per frame, on the GL thread: begin, then allocate (also from worker threads) and write, flush before the draws
+// that read the ranges, end after them.
+class UploadRing
+{
+public:
+    // region sizes are rounded to the largest alignment an allocation can ask for
+    static constexpr size_t MAX_ALIGNMENT = 256;
+
+    UploadRing(size_t regionSize, GLuint regions = 3, bool persistent = false)
+    {
+        this->regionSize = roundUp(max<size_t>(regionSize, MAX_ALIGNMENT));
+        this->fences.assign(max(regions, 2u), (GLsync)0);
+        this->persistent = persistent;
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformAlignment = (size_t)max(alignment, 1);
+        create();
+    }
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator =(const UploadRing&) = delete;
+
+    // moves to the next region, waiting for the GPU if it still reads it; grows the regions first when the
+    // last frames overflowed
+    void begin()
+    {
+        if (grow > regionSize) {
+            for (GLsync& fence: fences)
+                wait(fence);
+            destroy();
+            while (regionSize < grow)
+                regionSize *= 2;
+            create();
+            ++stats.growths;
+        }
+        grow = 0;
+
+        region = (region + 1) % fences.size();
+        wait(fences[region]);
+        space.reset(regionSize);
+        flushed = 0;
+        ++stats.frames;
+    }
+
+    // an aligned range of size bytes in this frame's region, data is nullptr when the region is full.
+    // Safe to call from several threads between begin and flush
+    UploadRange allocate(size_t size, size_t alignment = 16)
+    {
+        UploadRange range;
+        size_t offset = space.allocate(size, min(max<size_t>(alignment, 1), MAX_ALIGNMENT));
+        if (offset == LinearAllocator::NONE) {
+            overflows.fetch_add(1);
+            requested.fetch_add(size);
+            return range;
+        }
+        range.data = (persistent ? mapped + region * regionSize : staging.data()) + offset;
+        range.offset = (GLintptr)(region * regionSize + offset);
+        range.size = (GLsizeiptr)size;
+        allocations.fetch_add(1);
+        return range;
+    }
+
+    // makes the ranges written so far visible to the GPU, call on the GL thread once the writers are done
+    void flush()
+    {
+        size_t used = space.used();
+        if (persistent || used <= flushed) {
+            flushed = used;
+            return;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)(region * regionSize + flushed), (GLsizeiptr)(used - flushed),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (target != NULL) {
+            memcpy(target, staging.data() + flushed, used - flushed);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        else
+            cout << "ERROR::UPLOADRING::MAP_NOT_SUCCESFULLY_DONE" << endl;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        flushed = used;
+    }
+
+    // fences the region after the frame's draws; grows the regions at the next begin if allocations did not fit
+    void end()
+    {
+        flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stats.bytes += space.used();
+        stats.allocations += allocations.exchange(0);
+        size_t missed = overflows.exchange(0);
+        stats.overflows += missed;
+        if (missed > 0)
+            grow = space.used() + requested.load() + missed * MAX_ALIGNMENT;
+        requested.store(0);
+    }
+
+    GLuint getBuffer() const
+    {
+        return this->buffer;
+    }
+
+    bool isPersistent() const
+    {
+        return this->persistent;
+    }
+
+    size_t getRegionSize() const
+    {
+        return this->regionSize;
+    }
+
+    // the alignment glBindBufferRange needs for uniform blocks
+    size_t getUniformAlignment() const
+    {
+        return this->uniformAlignment;
+    }
+
+    const UploadRingStats& getStats() const
+    {
+        return this->stats;
+    }
+
+    // waits for the GPU and deletes the buffer, call on the GL thread while the context is alive
+    void release()
+    {
+        for (GLsync& fence: fences)
+            wait(fence);
+        destroy();
+    }
+
+private:
+    size_t regionSize;
+    size_t uniformAlignment = 1;
+    bool persistent;
+    GLuint buffer = 0;
+    // the persistent mapping of the whole buffer, or the CPU copy of the current region
+    unsigned char* mapped = nullptr;
+    vector<unsigned char> staging;
+    vector<GLsync> fences;
+    size_t region = 0;
+    LinearAllocator space;
+    // the end of what flush already sent
+    size_t flushed = 0;
+    // the region size the next begin has to reach
+    size_t grow = 0;
+    atomic<size_t> allocations{0}, overflows{0}, requested{0};
+    UploadRingStats stats;
+
+    static size_t roundUp(size_t size)
+    {
+        return (size + MAX_ALIGNMENT - 1) / MAX_ALIGNMENT * MAX_ALIGNMENT;
+    }
+
+    void create()
+    {
+        size_t size = regionSize * fences.size();
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)size, flags);
+            if (mapped == nullptr) {
+                cout << "ERROR::UPLOADRING::PERSISTENT_MAP_NOT_SUCCESFULLY_DONE" << endl;
+                // a buffer storage object cannot be respecified, start over with a plain one
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                persistent = false;
+            }
+        }
+        if (!persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+            staging.resize(regionSize);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        space.reset(0);
+    }
+
+    void destroy()
+    {
+        if (buffer == 0)
+            return;
+        if (mapped != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    // waits until the GPU passed fence and deletes it
+    void wait(GLsync& fence)
+    {
+        if (fence == 0)
+            return;
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            ++stats.waits;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+using namespace std;
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+
+    bool operator ==(const Vertex& x)
+    {
+        return (Position == x.Position && Normal == x.Normal);
+    }
+};
+
+// Compressed vertex, 12 bytes instead of 24: the position is quantized to 16 bits per axis inside the mesh
+// bounds (decoded in shader.vs with positionScale/positionOffset), the normal is a signed 10:10:10:2 value.
+struct PackedVertex {
+    GLushort Position[3];
+    GLushort Padding;
+    GLuint Normal;
+};
+
+enum VertexLayout {
+    VERTEX_FLOAT,
+    VERTEX_PACKED
+};
+
+// one glVertexAttribPointer call
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+struct VertexFormat {
+    GLsizei stride;
+    vector<VertexAttribute> attributes;
+};
+
+inline const VertexFormat& vertexFormat(VertexLayout layout)
+{
+    static const VertexFormat floatFormat = {
+        sizeof(Vertex), {
+            {0, 3, GL_FLOAT, GL_FALSE, 0},
+            {1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat)}
+        }
+    };
+    static const VertexFormat packedFormat = {
+        sizeof(PackedVertex), {
+            {0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0},
+            {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4 * sizeof(GLushort)}
+        }
+    };
+    return layout == VERTEX_PACKED ? packedFormat : floatFormat;
+}
+
+// Per-instance data of instanced draws (see InstanceRenderer.h), one per drawn copy of a mesh
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+// the instance attributes follow the vertex ones: model takes locations 2-5, normalMatrix 6-8.
+// The offsets are relative to where the instances of a draw start in the instance buffer.
+inline const VertexFormat& instanceFormat()
+{
+    static const VertexFormat format = {
+        sizeof(InstanceData), {
+            {2, 4, GL_FLOAT, GL_FALSE, 0},
+            {3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat)},
+            {4, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat)},
+            {5, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat)},
+            {6, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat)},
+            {7, 3, GL_FLOAT, GL_FALSE, 19 * sizeof(GLfloat)},
+            {8, 3, GL_FLOAT, GL_FALSE, 22 * sizeof(GLfloat)}
+        }
+    };
+    return format;
+}
+
+// packed meshes use 16-bit indices whenever every vertex can be addressed with them
+inline GLenum indexType(VertexLayout layout, size_t vertexCount)
+{
+    return layout == VERTEX_PACKED && vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline size_t indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+inline GLuint packNormal(glm::vec3 normal)
+{
+    glm::ivec3 q = glm::ivec3(glm::round(glm::clamp(normal, -1.0f, 1.0f) * 511.0f)) & 0x3FF;
+    return (GLuint)q.x | ((GLuint)q.y << 10) | ((GLuint)q.z << 20);
+}
+
+inline PackedVertex packVertex(const Vertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    glm::vec3 extent = boundsMax - boundsMin;
+    PackedVertex packed;
+    for (GLuint i = 0; i < 3; ++i) {
+        GLfloat t = extent[i] > 0.0f ? (vertex.Position[i] - boundsMin[i]) / extent[i] : 0.0f;
+        packed.Position[i] = (GLushort)glm::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+    }
+    packed.Padding = 0;
+    packed.Normal = packNormal(vertex.Normal);
+    return packed;
+}
+
+inline vector<PackedVertex> packVertices(const Vertex* vertices, size_t count, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    vector<PackedVertex> packed(count);
+    for (size_t i = 0; i < count; ++i)
+        packed[i] = packVertex(vertices[i], boundsMin, boundsMax);
+    return packed;
+}
+
+inline vector<GLushort> packIndices(const GLuint* indices, size_t count)
+{
+    return vector<GLushort>(indices, indices + count);
+}
+
+// the inverse of packNormal, the 10-bit fields are sign extended
+inline glm::vec3 unpackNormal(GLuint normal)
+{
+    glm::ivec3 q((GLint)(normal << 22) >> 22, (GLint)(normal << 12) >> 22, (GLint)(normal << 2) >> 22);
+    return glm::vec3(q) / 511.0f;
+}
+
+inline Vertex unpackVertex(const PackedVertex& packed, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    Vertex vertex;
+    vertex.Position = boundsMin + glm::vec3(packed.Position[0], packed.Position[1], packed.Position[2]) / 65535.0f * (boundsMax - boundsMin);
+    vertex.Normal = unpackNormal(packed.Normal);
+    return vertex;
+}
+
+// full precision vertices from a blob in layout, packed positions are decoded against the bounds they were packed in
+inline vector<Vertex> unpackVertices(const void* vertices, size_t count, VertexLayout layout, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    if (layout == VERTEX_FLOAT)
+        return vector<Vertex>((const Vertex*)vertices, (const Vertex*)vertices + count);
+    vector<Vertex> unpacked(count);
+    for (size_t i = 0; i < count; ++i)
+        unpacked[i] = unpackVertex(((const PackedVertex*)vertices)[i], boundsMin, boundsMax);
+    return unpacked;
+}
+
+inline vector<GLuint> unpackIndices(const void* indices, size_t count, GLenum type)
+{
+    if (type == GL_UNSIGNED_SHORT)
+        return vector<GLuint>((const GLushort*)indices, (const GLushort*)indices + count);
+    return vector<GLuint>((const GLuint*)indices, (const GLuint*)indices + count);
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef VERTEXWELDER_H
+#define VERTEXWELDER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Open addressing hash table from a 64-bit key to a vertex index.
+class WeldTable
+{
+public:
+    static constexpr GLuint EMPTY = 0xFFFFFFFFu;
+
+    // forgets all entries, keeping the memory unless the table became much larger than needed
+    void clear(size_t expected = 0)
+    {
+        size_t wanted = 16;
+        while (wanted < expected * 2)
+            wanted <<= 1;
+        if (keys.size() < wanted || keys.size() > wanted * 8) {
+            keys.assign(wanted, 0);
+            values.assign(wanted, EMPTY);
+        }
+        else if (count > 0)
+            fill(values.begin(), values.end(), EMPTY);
+        count = 0;
+    }
+
+    // returns the slot value for key, inserting value when the key is new
+    GLuint findOrInsert(uint64_t key, GLuint value)
+    {
+        if ((count + 1) * 2 > keys.size())
+            grow();
+
+        size_t mask = keys.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            if (values[i] == EMPTY) {
+                keys[i] = key;
+                values[i] = value;
+                ++count;
+                return value;
+            }
+            if (keys[i] == key)
+                return values[i];
+        }
+    }
+
+    // overwrites (or inserts) the value stored for key
+    void set(uint64_t key, GLuint value)
+    {
+        if ((count + 1) * 2 > keys.size())
+            grow();
+
+        size_t mask = keys.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            if (values[i] == EMPTY) {
+                keys[i] = key;
+                values[i] = value;
+                ++count;
+                return;
+            }
+            if (keys[i] == key) {
+                values[i] = value;
+                return;
+            }
+        }
+    }
+
+    GLuint find(uint64_t key) const
+    {
+        if (keys.empty())
+            return EMPTY;
+
+        size_t mask = keys.size() - 1;
+        for (size_t i = hash(key) & mask; values[i] != EMPTY; i = (i + 1) & mask)
+            if (keys[i] == key)
+                return values[i];
+        return EMPTY;
+    }
+
+private:
+    vector<uint64_t> keys;
+    vector<GLuint> values;
+    size_t count = 0;
+
+    static size_t hash(uint64_t key)
+    {
+        // splitmix64 finalizer
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebull;
+        key ^= key >> 31;
+        return (size_t)key;
+    }
+
+    void grow()
+    {
+        vector<uint64_t> oldKeys = std::move(keys);
+        vector<GLuint> oldValues = std::move(values);
+        size_t size = oldKeys.empty() ? 16 : oldKeys.size() * 2;
+        keys.assign(size, 0);
+        values.assign(size, EMPTY);
+        count = 0;
+        for (size_t i = 0; i < oldKeys.size(); ++i)
+            if (oldValues[i] != EMPTY)
+                set(oldKeys[i], oldValues[i]);
+    }
+};
+
+// Builds the welded vertex/index lists of one mesh from OBJ face corners.
+// By default corners are shared when they reference the same (v, vn) pair; with a positive epsilon
+// corners are also shared when their positions lie within epsilon and their normals match.
+class VertexWelder
+{
+public:
+    VertexWelder(GLfloat epsilon = 0.0f)
+    {
+        this->epsilon = epsilon;
+    }
+
+    // starts a new mesh, the welded data is written to the (empty) vertices/indices
+    void begin(vector<Vertex>* vertices, vector<GLuint>* indices, size_t expectedVertices = 0)
+    {
+        this->vertices = vertices;
+        this->indices = indices;
+        table.clear(expectedVertices);
+        next.clear();
+    }
+
+    // v and vn are resolved 0-based indices (-1 when missing)
+    void add(GLint v, GLint vn, const glm::vec3& position, const glm::vec3& normal)
+    {
+        GLuint index;
+        if (epsilon > 0.0f)
+            index = addNear(position, normal);
+        else {
+            uint64_t key = ((uint64_t)(uint32_t)v << 32) | (uint32_t)vn;
+            index = table.findOrInsert(key, (GLuint)vertices->size());
+            if (index == vertices->size())
+                vertices->push_back(Vertex{position, normal});
+        }
+        indices->push_back(index);
+    }
+
+private:
+    GLfloat epsilon;
+    WeldTable table;
+    // epsilon mode: chains of vertices falling into the same grid cell
+    vector<GLuint> next;
+    vector<Vertex>* vertices = nullptr;
+    vector<GLuint>* indices = nullptr;
+
+    static uint64_t cellKey(GLint x, GLint y, GLint z)
+    {
+        return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+    }
+
+    bool isNear(const Vertex& a, const glm::vec3& position, const glm::vec3& normal) const
+    {
+        glm::vec3 dp = glm::abs(a.Position - position);
+        glm::vec3 dn = glm::abs(a.Normal - normal);
+        return dp.x <= epsilon && dp.y <= epsilon && dp.z <= epsilon && dn.x <= epsilon && dn.y <= epsilon && dn.z <= epsilon;
+    }
+
+    GLuint addNear(const glm::vec3& position, const glm::vec3& normal)
+    {
+        glm::vec3 cell = glm::floor(position / epsilon);
+        GLint cx = (GLint)cell.x, cy = (GLint)cell.y, cz = (GLint)cell.z;
+
+        // a match within epsilon can only lie in this or a neighbouring cell
+        for (GLint dx = -1; dx <= 1; ++dx)
+            for (GLint dy = -1; dy <= 1; ++dy)
+                for (GLint dz = -1; dz <= 1; ++dz)
+                    for (GLuint i = table.find(cellKey(cx + dx, cy + dy, cz + dz)); i != WeldTable::EMPTY; i = next[i])
+                        if (isNear((*vertices)[i], position, normal))
+                            return i;
+
+        GLuint index = (GLuint)vertices->size();
+        uint64_t key = cellKey(cx, cy, cz);
+        next.push_back(table.find(key));
+        table.set(key, index);
+        vertices->push_back(Vertex{position, normal});
+        return index;
+    }
+};
+
+#endif
@@ -14,7 +14,6 @@ struct DirLight {
     vec3 diffuse;
     vec3 specular;
 };  
-uniform DirLight dirLight;
 
 struct PointLight {    
     vec3 position;
@@ -30,21 +29,70 @@ struct PointLight {
 
 in vec3 FragPos;  
 in vec3 Normal;
-  
-uniform vec3 viewPos;
-uniform Material material;
+// the material of the draw, passed on by the vertex shader (see shader.vs)
+flat in vec3 MaterialAmbient;
+flat in vec3 MaterialDiffuse;
+flat in vec3 MaterialSpecular;
+flat in float MaterialShininess;
+
+Material material;
+
+// clustered point lights (see ClusteredLights.h): 4 texels per light (position + constant, ambient + linear,
+// diffuse + quadratic, specular), (first, count) per cluster into the index list
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+// clusters along x, y and depth; tiles per pixel and the slice of a view depth: log(depth) * clusterScale.z + clusterBias
+uniform vec3 clusterCounts;
+uniform vec3 clusterScale;
+uniform float clusterBias;
+
+// per-frame data shared by every program, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 viewPos;
+    vec4 lightDirection;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {
+    material = Material(MaterialAmbient, MaterialDiffuse, MaterialSpecular, MaterialShininess);
     // свойства
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
 
     // фаза 1: Направленный источник освещения
+    DirLight dirLight = DirLight(lightDirection.xyz, lightAmbient.xyz, lightDiffuse.xyz, lightSpecular.xyz);
     vec3 result = CalcDirLight(dirLight, norm, viewDir);    
+
+    // фаза 2: точечные источники света из кластера фрагмента (left out of the NO_POINT_LIGHTS permutation)
+#ifndef NO_POINT_LIGHTS
+    if (clusterCounts.x > 0.0) {
+        float depth = -(view * vec4(FragPos, 1.0)).z;
+        ivec3 cell = ivec3(vec3(gl_FragCoord.xy * clusterScale.xy, log(max(depth, 1e-4)) * clusterScale.z + clusterBias));
+        cell = clamp(cell, ivec3(0), ivec3(clusterCounts) - 1);
+        int cluster = cell.x + int(clusterCounts.x) * (cell.y + int(clusterCounts.y) * cell.z);
+        uvec2 range = texelFetch(lightGrid, cluster).xy;
+        for (uint i = 0u; i < range.y; ++i) {
+            int light = int(texelFetch(lightIndices, int(range.x + i)).x) * 4;
+            vec4 positionConstant = texelFetch(lightData, light);
+            vec4 ambientLinear = texelFetch(lightData, light + 1);
+            vec4 diffuseQuadratic = texelFetch(lightData, light + 2);
+            vec4 specular = texelFetch(lightData, light + 3);
+            PointLight pointLight = PointLight(positionConstant.xyz, positionConstant.w, ambientLinear.w, diffuseQuadratic.w,
+                ambientLinear.xyz, diffuseQuadratic.xyz, specular.xyz);
+            result += CalcPointLight(pointLight, norm, FragPos, viewDir);
+        }
+    }
+#endif
     
     gl_FragColor = vec4(result, 1.0);
 }
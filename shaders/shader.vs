@@ -1,17 +1,86 @@
 #version 330 core
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+// per-instance transform of instanced draws (see InstanceRenderer.h)
+layout (location = 2) in mat4 instanceModel;
+layout (location = 6) in mat3 instanceNormalMatrix;
+// index of the draw in multi-draw-indirect draws, selects its draw record (see IndirectDraw.h)
+layout (location = 9) in uint drawIndex;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
 
 out vec3 Normal;
 out vec3 FragPos;
+// the material of the draw, from the uniform or from the material table
+flat out vec3 MaterialAmbient;
+flat out vec3 MaterialDiffuse;
+flat out vec3 MaterialSpecular;
+flat out float MaterialShininess;
+
+uniform Material material;
+
+// decodes quantized positions of packed meshes, (1, 1, 1) and (0, 0, 0) for float ones
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// inverse transpose of mat3(model), computed once per object on the CPU (see Model::setModel)
+uniform mat3 normalMatrix;
+// true for instanced draws, which take the transform from the instance attributes instead of the two above
+uniform bool instanced;
+// true for multi-draw-indirect draws, which fetch all of the above and the material per draw
+uniform bool indirect;
+// 9 texels per draw: model, normal matrix, positionScale with the material index in w, positionOffset
+uniform samplerBuffer drawRecords;
+// 3 texels per material: ambient with the shininess in w, diffuse, specular
+uniform samplerBuffer materialTable;
+
+// per-frame data shared by every program, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 viewPos;
+    vec4 lightDirection;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
 
 void main()
 {
-    gl_Position = projection * view *  model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;
+    mat4 objectModel = instanced ? instanceModel : model;
+    mat3 objectNormalMatrix = instanced ? instanceNormalMatrix : normalMatrix;
+    vec3 scale = positionScale;
+    vec3 offset = positionOffset;
+    Material surface = material;
+    if (indirect) {
+        int record = int(drawIndex) * 9;
+        objectModel = mat4(texelFetch(drawRecords, record), texelFetch(drawRecords, record + 1),
+            texelFetch(drawRecords, record + 2), texelFetch(drawRecords, record + 3));
+        objectNormalMatrix = mat3(texelFetch(drawRecords, record + 4).xyz, texelFetch(drawRecords, record + 5).xyz,
+            texelFetch(drawRecords, record + 6).xyz);
+        vec4 scaleAndMaterial = texelFetch(drawRecords, record + 7);
+        scale = scaleAndMaterial.xyz;
+        offset = texelFetch(drawRecords, record + 8).xyz;
+
+        int entry = int(scaleAndMaterial.w) * 3;
+        vec4 ambient = texelFetch(materialTable, entry);
+        surface = Material(ambient.xyz, texelFetch(materialTable, entry + 1).xyz, texelFetch(materialTable, entry + 2).xyz, ambient.w);
+    }
+    MaterialAmbient = surface.ambient;
+    MaterialDiffuse = surface.diffuse;
+    MaterialSpecular = surface.specular;
+    MaterialShininess = surface.shininess;
+
+    vec3 localPosition = position * scale + offset;
+    vec4 worldPosition = objectModel * vec4(localPosition, 1.0f);
+    gl_Position = viewProjection * worldPosition;
+    FragPos = vec3(worldPosition);
+    Normal = objectNormalMatrix * normal;
 } 
\ No newline at end of file
@@ -0,0 +1,1024 @@
+// OBJ loading benchmark: the line based loader Model used before vs the memory-mapped tokenizer,
+// the single threaded tokenizer vs the chunked parallel one, parsing vs mapping the binary mesh cache,
+// the post-transform cache efficiency (ACMR/ATVR) before and after the mesh optimizer,
+// the GPU size and precision of the packed vertex layout, the render queue radix sort vs std::sort,
+// the fragmentation of the geometry arena allocator under mesh churn, SIMD vs scalar frustum culling,
+// software occlusion culling behind a wall, binning point lights into clusters, the upload ring's
+// allocator shared by several threads, handing frame packets from a simulation to a render thread, a whole
+// frame drawn headless on the null graphics backend, the profiler's zones and Chrome trace export, and cold vs warm
+// builds of shader permutations through the program binary cache.
+// usage: benchmark [faces of the synthetic model, 10000000 by default] [parallel loader threads, all by default]
+#include <glad/glad.h>
+
+#include "ClusteredLights.h"
+#include "FrameRenderer.h"
+#include "GraphicsDevice.h"
+#include "Model.h"
+#include "Profiler.h"
+#include "ShaderLibrary.h"
+#include "UploadRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+// the previous Model::loadModel / Model::setMaterials, kept as the reference implementation
+void loadMtlLegacy(const string& path, map<string, Material>& materials)
+{
+    string line, nameMaterial;
+    vector<string> lines;
+
+    ifstream in(path);
+    if (in.is_open())
+        while (getline(in, line))
+            lines.push_back(line);
+    in.close();
+
+    for (string line: lines) {
+        vector<string> elements = getElementsString(line, ' ');
+
+        if (elements[0] == "newmtl")
+            nameMaterial = elements[1];
+        else if (elements[0] == "Ns")
+            materials[nameMaterial].Shininess = stof(elements[1]);
+        else if (elements[0] == "Ka")
+            materials[nameMaterial].Ambient = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
+        else if (elements[0] == "Kd")
+            materials[nameMaterial].Diffuse = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
+        else if (elements[0] == "Ks")
+            materials[nameMaterial].Specular = glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3]));
+    }
+}
+
+void loadObjLegacy(const string& path, ModelData& data)
+{
+    vector<string> lines;
+    string line;
+    string directory = path.substr(0, path.find_last_of('/')) + "/";
+    string nameMaterial;
+
+    vector<glm::vec3> vertex;
+    vector<glm::vec3> normal;
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+
+    ifstream in(path);
+    if (in.is_open())
+        while (getline(in, line))
+            lines.push_back(line);
+    in.close();
+
+    for (string line: lines) {
+        vector<string> elements = getElementsString(line, ' ');
+
+        if (elements[0] == "o") {
+            if (vertices.empty())
+                continue;
+
+            data.meshes.push_back(MeshData{vertices, indices, nameMaterial, {}});
+            vertices.clear();
+            indices.clear();
+        }
+        else if (elements[0] == "mtllib")
+            loadMtlLegacy(directory + elements[1], data.materials);
+        else if (elements[0] == "v")
+            vertex.push_back(glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3])));
+        else if (elements[0] == "vn")
+            normal.push_back(glm::vec3(stof(elements[1]), stof(elements[2]), stof(elements[3])));
+        else if (elements[0] == "usemtl")
+            nameMaterial = elements[1];
+        else if (elements[0] == "f") {
+            for (GLuint i = 1; i < 4; ++i) {
+                vector<string> a = getElementsString(elements[i], '/');
+
+                Vertex now;
+                now.Position = vertex[stoi(a[0]) - 1];
+                now.Normal = normal[stoi(a[1]) - 1];
+
+                auto search = find(vertices.begin(), vertices.end(), now);
+
+                if (search == vertices.end()) {
+                    indices.push_back(vertices.size());
+                    vertices.push_back(now);
+                }
+                else
+                    indices.push_back(search - vertices.begin());
+            }
+        }
+    }
+
+    if (!vertices.empty())
+        data.meshes.push_back(MeshData{vertices, indices, nameMaterial, {}});
+}
+
+// a grid of quads split into small objects, so the per-object vertex search stays cheap for both loaders
+void writeSyntheticObj(const string& path, size_t faces)
+{
+    const size_t facesPerObject = 128;
+    const size_t width = 256;
+    size_t quads = (faces + 1) / 2;
+    size_t rows = (quads + width - 1) / width;
+
+    ofstream out(path);
+    out << "# synthetic benchmark model\n";
+    for (size_t y = 0; y <= rows; ++y)
+        for (size_t x = 0; x <= width; ++x)
+            out << "v " << x * 0.1f << " " << (x * y % 7) * 0.01f << " " << y * 0.1f << "\n";
+    out << "vn 0.000000 1.000000 0.000000\n";
+
+    size_t written = 0;
+    for (size_t q = 0; q < quads && written < faces; ++q) {
+        if (written % facesPerObject == 0)
+            out << "o Part" << written / facesPerObject << "\n";
+        size_t x = q % width, y = q / width;
+        size_t a = y * (width + 1) + x + 1, b = a + 1, c = a + width + 1, d = c + 1;
+        out << "f " << a << "//1 " << c << "//1 " << b << "//1\n";
+        if (++written < faces)
+            out << "f " << b << "//1 " << c << "//1 " << d << "//1\n";
+        ++written;
+    }
+}
+
+bool sameData(const ModelData& a, const ModelData& b)
+{
+    if (a.meshes.size() != b.meshes.size())
+        return false;
+    for (size_t i = 0; i < a.meshes.size(); ++i) {
+        const MeshData& x = a.meshes[i];
+        const MeshData& y = b.meshes[i];
+        if (x.material != y.material || x.indices != y.indices || x.vertices.size() != y.vertices.size())
+            return false;
+        for (size_t j = 0; j < x.vertices.size(); ++j)
+            if (x.vertices[j].Position != y.vertices[j].Position || x.vertices[j].Normal != y.vertices[j].Normal)
+                return false;
+    }
+    return true;
+}
+
+// the same as sameData for meshes read back from a packed cache: positions within a step of the 16-bit grid over
+// the mesh bounds, normals within a step of the 10-bit one
+bool samePackedData(const ModelData& a, const ModelData& b)
+{
+    if (a.meshes.size() != b.meshes.size())
+        return false;
+    for (size_t i = 0; i < a.meshes.size(); ++i) {
+        const MeshData& x = a.meshes[i];
+        const MeshData& y = b.meshes[i];
+        if (x.material != y.material || x.indices != y.indices || x.vertices.size() != y.vertices.size())
+            return false;
+        glm::vec3 boundsMin, boundsMax;
+        Mesh::computeBounds(x.vertices.data(), x.vertices.size(), boundsMin, boundsMax);
+        glm::vec3 step = (boundsMax - boundsMin) / 65535.0f + 1e-6f;
+        for (size_t j = 0; j < x.vertices.size(); ++j)
+            if (glm::any(glm::greaterThan(glm::abs(x.vertices[j].Position - y.vertices[j].Position), step))
+                || glm::any(glm::greaterThan(glm::abs(x.vertices[j].Normal - y.vertices[j].Normal), glm::vec3(1.0f / 511.0f))))
+                return false;
+    }
+    return true;
+}
+
+// decodes the meshes of a mapped cache back into a ModelData (as Mesh does for its CPU copy), to compare them with a parse
+void readMeshCache(const MeshCache& cache, ModelData& data)
+{
+    for (size_t i = 0; i < cache.meshCount(); ++i) {
+        const MeshCacheMesh& mesh = cache.mesh(i);
+        glm::vec3 boundsMin(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+        glm::vec3 boundsMax(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+        data.meshes.push_back(MeshData{
+            unpackVertices(cache.vertices(i), mesh.vertexCount, cache.layout(), boundsMin, boundsMax),
+            unpackIndices(cache.indices(i), cache.lods(i)[0].indexCount, indexType(cache.layout(), mesh.vertexCount)),
+            string(cache.materialName(mesh.material)), {}});
+    }
+}
+
+template <typename F>
+double bestTime(GLuint runs, F load)
+{
+    double best = 1e30;
+    for (GLuint i = 0; i < runs; ++i) {
+        auto start = chrono::steady_clock::now();
+        load();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+void compare(const string& path, GLuint runs, unsigned threads)
+{
+    ModelData legacy, mapped;
+    loadObjLegacy(path, legacy);
+    loadObj(path, mapped);
+
+    double legacyTime = bestTime(runs, [&]() { ModelData data; loadObjLegacy(path, data); });
+    double mappedTime = bestTime(runs, [&]() { ModelData data; loadObj(path, data); });
+
+    cout << path << "\n";
+    cout << "    legacy loader:  " << legacyTime << " ms\n";
+    cout << "    mapped loader:  " << mappedTime << " ms (x" << legacyTime / mappedTime << ")\n";
+    cout << "    results match:  " << (sameData(legacy, mapped) ? "yes" : "NO") << "\n";
+
+    ObjLoadOptions options;
+    options.threads = threads;
+    ModelData parallel;
+    loadObjParallel(path, parallel, options);
+    double parallelTime = bestTime(runs, [&]() { ModelData data; loadObjParallel(path, data, options); });
+
+    cout << "    parallel loader (" << resolveThreadCount(options.threads) << " threads): " << parallelTime << " ms (x" << mappedTime / parallelTime << " over mapped)\n";
+    cout << "    results match:  " << (sameData(mapped, parallel) ? "yes" : "NO") << "\n";
+
+    string cachePath = meshCachePath(path, ObjLoadOptions());
+    if (!writeMeshCache(cachePath, path, mapped, ObjLoadOptions())) {
+        cout << "    mesh cache:     NOT WRITTEN\n";
+        return;
+    }
+    double cacheTime = bestTime(runs, [&]() { MeshCache cache; cache.open(cachePath, path, ObjLoadOptions()); });
+
+    MeshCache cache;
+    ModelData cached;
+    bool opened = cache.open(cachePath, path, ObjLoadOptions());
+    if (opened)
+        readMeshCache(cache, cached);
+
+    cout << "    mesh cache map: " << cacheTime << " ms (x" << mappedTime / cacheTime << " over mapped)\n";
+    cout << "    results match:  " << (opened && sameData(mapped, cached) ? "yes" : "NO") << "\n";
+    remove(cachePath.c_str());
+
+    // a packed cache decodes to the parse within the quantization, that is the CPU copy occluders draw from
+    ObjLoadOptions packedOptions;
+    packedOptions.compressVertices = true;
+    string packedPath = meshCachePath(path, packedOptions);
+    MeshCache packedCache;
+    ModelData packed;
+    bool packedOpened = writeMeshCache(packedPath, path, mapped, packedOptions) && packedCache.open(packedPath, path, packedOptions);
+    if (packedOpened)
+        readMeshCache(packedCache, packed);
+    cout << "    packed cache decoded\n";
+    cout << "    results match:  " << (packedOpened && samePackedData(mapped, packed) ? "yes" : "NO") << "\n";
+    remove(packedPath.c_str());
+
+    // the synthetic model is split into many small objects, so report the meshes as a whole
+    VertexCacheStats before, after;
+    size_t triangles = 0, vertices = 0;
+    double optimizeTime = bestTime(1, [&]() {
+        for (MeshData& mesh: mapped.meshes) {
+            MeshOptimizationReport report = optimizeMesh(mesh.vertices, mesh.indices);
+            size_t t = mesh.indices.size() / 3, v = mesh.vertices.size();
+            before.acmr += report.before.acmr * t;
+            after.acmr += report.after.acmr * t;
+            before.atvr += report.before.atvr * v;
+            after.atvr += report.after.atvr * v;
+            triangles += t;
+            vertices += v;
+        }
+    });
+    size_t floatBytes = 0, packedBytes = 0;
+    GLfloat positionError = 0.0f, normalError = 0.0f;
+    for (const MeshData& mesh: mapped.meshes) {
+        glm::vec3 boundsMin, boundsMax;
+        Mesh::computeBounds(mesh.vertices.data(), mesh.vertices.size(), boundsMin, boundsMax);
+        vector<PackedVertex> packed = packVertices(mesh.vertices.data(), mesh.vertices.size(), boundsMin, boundsMax);
+        floatBytes += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+        packedBytes += packed.size() * sizeof(PackedVertex) + mesh.indices.size() * indexSize(indexType(VERTEX_PACKED, packed.size()));
+
+        // decode the way the GPU does
+        for (size_t i = 0; i < packed.size(); ++i) {
+            glm::vec3 position = glm::vec3(packed[i].Position[0], packed[i].Position[1], packed[i].Position[2]) / 65535.0f * (boundsMax - boundsMin) + boundsMin;
+            glm::ivec3 n = (glm::ivec3(packed[i].Normal, packed[i].Normal >> 10, packed[i].Normal >> 20) & 0x3FF);
+            n -= glm::ivec3(glm::greaterThanEqual(n, glm::ivec3(512))) * 1024;
+            glm::vec3 normal = glm::max(glm::vec3(n) / 511.0f, -1.0f);
+            positionError = max(positionError, glm::length(position - mesh.vertices[i].Position));
+            normalError = max(normalError, glm::length(normal - mesh.vertices[i].Normal));
+        }
+    }
+    cout << "    packed layout:  " << floatBytes / 1024 << " KB -> " << packedBytes / 1024 << " KB, max error position "
+         << positionError << ", normal " << normalError << "\n";
+
+    cout << "    optimizer:      " << optimizeTime << " ms, ACMR " << before.acmr / triangles << " -> " << after.acmr / triangles
+         << ", ATVR " << before.atvr / vertices << " -> " << after.atvr / vertices << "\n";
+
+    // triangles and largest error per level of detail, summed over the meshes
+    vector<size_t> lodTriangles(1, triangles);
+    vector<GLfloat> lodErrors(1, 0.0f);
+    double lodTime = bestTime(1, [&]() {
+        for (const MeshData& mesh: mapped.meshes) {
+            vector<MeshLodData> lods = buildLodChain(mesh.vertices, mesh.indices, 4);
+            for (size_t l = 0; l < 4; ++l) {
+                // a mesh whose chain ended early keeps drawing its coarsest level
+                const vector<GLuint>& indices = lods.empty() ? mesh.indices : lods[min(l, lods.size() - 1)].indices;
+                if (lodTriangles.size() <= l + 1) {
+                    lodTriangles.push_back(0);
+                    lodErrors.push_back(0.0f);
+                }
+                lodTriangles[l + 1] += indices.size() / 3;
+                if (!lods.empty())
+                    lodErrors[l + 1] = max(lodErrors[l + 1], lods[min(l, lods.size() - 1)].error);
+            }
+        }
+    });
+    cout << "    lod chain:      " << lodTime << " ms, triangles";
+    for (size_t l = 0; l < lodTriangles.size(); ++l)
+        cout << (l ? " -> " : " ") << lodTriangles[l] << " (" << lodErrors[l] << ")";
+    cout << "\n";
+}
+
+// the level of detail chain of a mesh scaled 1x, 10x and 100x: the same triangles per level, and errors (which
+// Model::selectLod projects to pixels) that grow with the scale, not with its square
+void compareLodScale(const string& path)
+{
+    ModelData data;
+    loadObj(path, data);
+    if (data.meshes.empty())
+        return;
+    const MeshData& mesh = data.meshes[0];
+
+    vector<vector<MeshLodData>> chains;
+    for (GLfloat scale: {1.0f, 10.0f, 100.0f}) {
+        vector<Vertex> vertices = mesh.vertices;
+        for (Vertex& vertex: vertices)
+            vertex.Position *= scale;
+        chains.push_back(buildLodChain(vertices, mesh.indices, 4));
+    }
+
+    bool match = !chains[0].empty();
+    for (size_t s = 1; s < chains.size(); ++s) {
+        GLfloat scale = s == 1 ? 10.0f : 100.0f;
+        match = match && chains[s].size() == chains[0].size();
+        for (size_t l = 0; match && l < chains[0].size(); ++l)
+            // within 5%: rounding breaks ties between equal collapses of the symmetric sphere differently per scale
+            match = chains[s][l].indices.size() == chains[0][l].indices.size()
+                && fabs(chains[s][l].error - chains[0][l].error * scale) <= 0.05f * chains[0][l].error * scale;
+    }
+
+    cout << "lod error scale (" << path << ")\n";
+    for (size_t s = 0; s < chains.size(); ++s) {
+        cout << "    " << (s == 0 ? "1x:  " : s == 1 ? "10x: " : "100x:") << "          triangles";
+        for (const MeshLodData& lod: chains[s])
+            cout << " " << lod.indices.size() / 3 << " (" << lod.error << ")";
+        cout << "\n";
+    }
+    cout << "    results match:  " << (match ? "yes" : "NO") << " (the same levels, errors proportional to the scale)\n";
+}
+
+// sorts render queue keys shaped like a frame of draws: few programs and materials, many meshes and depths
+void compareSort(size_t count)
+{
+    mt19937_64 random(1);
+    vector<uint64_t> keys(count);
+    for (uint64_t& key: keys)
+        key = (random() % 4) << 56 | (random() % 64) << 40 | (random() % 2000) << 24 | (random() & 0xFFFFFF);
+
+    vector<uint64_t> radixKeys;
+    vector<uint32_t> order(count);
+    double radixTime = bestTime(5, [&]() {
+        radixKeys = keys;
+        for (uint32_t i = 0; i < count; ++i)
+            order[i] = i;
+        radixSort(radixKeys, order);
+    });
+
+    vector<pair<uint64_t, uint32_t>> pairs;
+    double stdTime = bestTime(5, [&]() {
+        pairs.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+            pairs[i] = make_pair(keys[i], i);
+        stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    });
+
+    bool same = true;
+    for (size_t i = 0; i < count; ++i)
+        same = same && radixKeys[i] == pairs[i].first && order[i] == pairs[i].second;
+
+    // state changes left when the sorted items are submitted, program + material + mesh per item unsorted
+    size_t changes = 0;
+    for (size_t i = 0; i < count; ++i)
+        for (GLuint shift: {56, 40, 24})
+            changes += i == 0 || (radixKeys[i] >> shift) != (radixKeys[i - 1] >> shift);
+
+    cout << "render queue (" << count << " items)\n";
+    cout << "    radix sort:     " << radixTime << " ms (x" << stdTime / radixTime << " over std::stable_sort)\n";
+    cout << "    results match:  " << (same ? "yes" : "NO") << "\n";
+    cout << "    state changes:  " << 3 * count << " -> " << changes << "\n";
+
+    // the same frame drawn with multi-draw indirect: one call per run of program and VAO, which lead the key
+    // in that mode. Meshes share the VAO of their arena, so there are only a few
+    vector<uint64_t> indirectKeys(count);
+    for (uint64_t& key: indirectKeys)
+        key = (random() % 4) << 56 | (random() % 3) << 40 | (random() % 64) << 24 | (random() & 0xFFFFFF);
+    vector<uint32_t> indirectOrder(count);
+    for (uint32_t i = 0; i < count; ++i)
+        indirectOrder[i] = i;
+    radixSort(indirectKeys, indirectOrder);
+    size_t drawCalls = 0;
+    for (size_t i = 0; i < count; ++i)
+        drawCalls += i == 0 || (indirectKeys[i] >> 40) != (indirectKeys[i - 1] >> 40);
+    cout << "    indirect draws: " << count << " -> " << drawCalls << " draw calls\n";
+}
+
+// streams meshes of random sizes in and out of an arena sized range allocator, the way levels load and unload models
+void compareArena(size_t operations)
+{
+    mt19937_64 random(1);
+    RangeAllocator space;
+    space.reset(GeometryArena::INITIAL_VERTICES);
+    vector<pair<size_t, size_t>> live;
+    size_t failures = 0, maxRanges = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < operations; ++i) {
+        if (!live.empty() && random() % 2 == 0) {
+            size_t index = random() % live.size();
+            space.free(live[index].first, live[index].second);
+            live[index] = live.back();
+            live.pop_back();
+            continue;
+        }
+        size_t size = 24 + random() % 4000;
+        size_t offset = space.allocate(size);
+        if (offset == RangeAllocator::NONE) {
+            ++failures;
+            continue;
+        }
+        live.push_back(make_pair(offset, size));
+        maxRanges = max(maxRanges, space.freeRangeCount());
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    size_t liveSize = 0;
+    for (const auto& range: live)
+        liveSize += range.second;
+    bool consistent = liveSize + space.freeSpace() == space.getCapacity();
+    for (const auto& range: live)
+        space.free(range.first, range.second);
+    // every neighbour merged again, nothing leaked
+    bool coalesced = space.freeRangeCount() == 1 && space.largestFreeRange() == space.getCapacity();
+
+    cout << "geometry arena (" << operations << " allocations and frees)\n";
+    cout << "    allocator:      " << elapsed.count() << " ms, " << failures << " allocations needed a compaction or growth, "
+         << maxRanges << " free ranges at most\n";
+    cout << "    results match:  " << (consistent && coalesced ? "yes" : "NO") << "\n";
+}
+
+// culls boxes scattered around a camera, most of them off-screen as in a level
+void compareCulling(size_t count)
+{
+    mt19937 random(1);
+    uniform_real_distribution<GLfloat> position(-100.0f, 100.0f), size(0.5f, 4.0f), angle(0.0f, 6.2831853f);
+    FrustumCuller culler;
+    for (size_t i = 0; i < count; ++i) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+        model = glm::rotate(model, angle(random), glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)));
+        culler.add(glm::vec3(-size(random)), glm::vec3(size(random)), model);
+    }
+    Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+    Frustum frustum = camera.GetFrustum(glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f));
+
+    vector<uint32_t> simd, scalar;
+    double simdTime = bestTime(10, [&]() { simd = culler.cull(frustum); });
+    double scalarTime = bestTime(10, [&]() { scalar = culler.cullScalar(frustum); });
+
+    cout << "frustum culling (" << count << " boxes)\n";
+    cout << "    batched cull:   " << simdTime << " ms (x" << scalarTime / simdTime << " over scalar), "
+         << 100.0 * simd.size() / count << "% visible\n";
+    cout << "    results match:  " << (simd == scalar ? "yes" : "NO") << "\n";
+}
+
+// calls of a per-frame sized job (8 items, as the occlusion bands) through parallelFor, which starts its threads every
+// call, and through a ThreadPool, whose threads stay; every item has to run once per call, also while the pool is busy
+void compareFrameWorkers(size_t calls, unsigned threads)
+{
+    const size_t items = 8;
+    vector<atomic<size_t>> hits(items);
+    auto job = [&](size_t i) { hits[i]++; };
+
+    double spawnTime = bestTime(1, [&]() {
+        for (size_t c = 0; c < calls; ++c)
+            parallelFor(items, threads, job);
+    });
+    // outlives the pool, whose threads read it until they are joined
+    atomic<bool> release(false);
+    ThreadPool pool(threads);
+    double poolTime = bestTime(1, [&]() {
+        for (size_t c = 0; c < calls; ++c)
+            pool.parallelFor(items, threads, job);
+    });
+
+    // every pool thread is held up, the calling thread has to do all items itself
+    for (unsigned t = 0; t < resolveThreadCount(threads); ++t)
+        pool.submit([&]() { while (!release.load()) this_thread::yield(); });
+    pool.parallelFor(items, threads, job);
+    release.store(true);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < items; ++i)
+        wrong += hits[i].load() != 2 * calls + 1;
+
+    cout << "frame workers (" << calls << " calls of " << items << " items, " << resolveThreadCount(threads) << " threads)\n";
+    cout << "    parallelFor:    " << spawnTime << " ms, thread pool " << poolTime << " ms (x" << spawnTime / poolTime << ")\n";
+    cout << "    results match:  " << (wrong == 0 ? "yes" : "NO") << " (" << wrong << " items not run once per call)\n";
+}
+
+// boxes scattered in front of and behind a wall facing the camera: none in front may be culled,
+// and the ones entirely in the wall's shadow should be
+void compareOcclusion(size_t count, unsigned threads)
+{
+    const GLfloat wallHalf = 3.0f, wallFront = -9.5f, wallBack = -10.5f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    Camera camera(glm::vec3(0.0f));
+    glm::mat4 viewProjection = projection * camera.GetViewMatrix();
+    vector<glm::vec3> wall = {
+        glm::vec3(-wallHalf, -wallHalf, wallFront), glm::vec3(wallHalf, -wallHalf, wallFront),
+        glm::vec3(wallHalf, -wallHalf, wallBack), glm::vec3(-wallHalf, -wallHalf, wallBack),
+        glm::vec3(-wallHalf, wallHalf, wallFront), glm::vec3(wallHalf, wallHalf, wallFront),
+        glm::vec3(wallHalf, wallHalf, wallBack), glm::vec3(-wallHalf, wallHalf, wallBack)
+    };
+
+    OcclusionCuller occlusion(256, 128, threads);
+    double rasterTime = bestTime(20, [&]() {
+        occlusion.begin(viewProjection);
+        occlusion.addBox(wall);
+        occlusion.finish();
+    });
+
+    mt19937 random(1);
+    uniform_real_distribution<GLfloat> across(-8.0f, 8.0f), along(-60.0f, -2.0f), size(0.1f, 1.0f);
+    vector<pair<glm::vec3, glm::vec3>> boxes(count);
+    for (auto& box: boxes) {
+        glm::vec3 centre(across(random), across(random), along(random)), half(size(random));
+        box = make_pair(centre - half, centre + half);
+    }
+
+    vector<bool> visible(count);
+    double testTime = bestTime(5, [&]() {
+        for (size_t i = 0; i < count; ++i)
+            visible[i] = occlusion.visible(boxes[i].first, boxes[i].second, glm::mat4(1.0f));
+    });
+
+    // whether the box is behind the front of the wall and inside the cone from the camera through it, widened by
+    // margin (a couple of pixels) for the rasterizer's pixel centres
+    GLfloat pixels = 2.0f * wallHalf / -wallFront / 128.0f;
+    auto shadowed = [&](const glm::vec3& low, const glm::vec3& high, GLfloat margin) {
+        if (high.z > wallFront)
+            return false;
+        for (GLuint c = 0; c < 8; ++c) {
+            glm::vec3 corner((c & 1) ? high.x : low.x, (c & 2) ? high.y : low.y, (c & 4) ? high.z : low.z);
+            GLfloat limit = wallHalf / -wallFront + margin;
+            if (fabs(corner.x / -corner.z) >= limit || fabs(corner.y / -corner.z) >= limit)
+                return false;
+        }
+        return true;
+    };
+    size_t wrong = 0, hidden = 0, culled = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool hides = shadowed(boxes[i].first, boxes[i].second, -2.0f * pixels) && boxes[i].second.z < wallBack;
+        hidden += hides;
+        culled += hides && !visible[i];
+        wrong += !visible[i] && !shadowed(boxes[i].first, boxes[i].second, 2.0f * pixels);
+    }
+
+    cout << "occlusion culling (" << count << " boxes, " << resolveThreadCount(threads) << " threads)\n";
+    cout << "    rasterize:      " << rasterTime << " ms for " << occlusion.getStats().triangles << " triangles, tests "
+         << testTime << " ms\n";
+    cout << "    hidden culled:  " << culled << " of " << hidden << "\n";
+    cout << "    results match:  " << (wrong == 0 ? "yes" : "NO") << " (" << wrong << " visible boxes culled)\n";
+}
+
+// bins count lights around the camera, then checks that every light reaching a point is in the list of its cluster
+void compareClusters(size_t count, unsigned threads)
+{
+    mt19937 random(1);
+    uniform_real_distribution<GLfloat> across(-40.0f, 40.0f), along(-90.0f, 5.0f), unit(0.0f, 1.0f);
+    vector<PointLight> lights(count);
+    for (PointLight& light: lights) {
+        glm::vec3 colour(unit(random), unit(random), unit(random));
+        light = PointLight{glm::vec3(across(random), across(random) * 0.5f, along(random)), 1.0f, 2.0f, 10.0f, colour * 0.01f, colour * 0.3f, colour * 0.3f};
+    }
+
+    Camera camera(glm::vec3(0.0f));
+    glm::mat4 view = camera.GetViewMatrix();
+    ClusteredLights clusters(threads);
+    clusters.setProjection(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f, 1280, 720);
+    double buildTime = bestTime(10, [&]() {
+        clusters.build(lights, view);
+    });
+
+    // random view space points inside the frustum
+    const GLuint samples = 100000;
+    const vector<uint32_t>& grid = clusters.getGrid();
+    const vector<uint32_t>& indices = clusters.getIndices();
+    GLfloat tanY = tan(glm::radians(45.0f) * 0.5f), tanX = tanY * 1280.0f / 720.0f;
+    size_t missing = 0, shaded = 0, reaching = 0;
+    for (GLuint s = 0; s < samples; ++s) {
+        GLfloat depth = 0.1f * pow(1000.0f, unit(random));
+        glm::vec3 point((unit(random) * 2.0f - 1.0f) * depth * tanX, (unit(random) * 2.0f - 1.0f) * depth * tanY, -depth);
+        GLint cluster = clusters.clusterOf(point);
+        if (cluster < 0)
+            continue;
+        uint32_t first = grid[2 * cluster], listed = grid[2 * cluster + 1];
+        shaded += listed;
+        for (size_t i = 0; i < lights.size(); ++i) {
+            glm::vec3 centre = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            if (glm::length(point - centre) > pointLightRadius(lights[i], 100.0f))
+                continue;
+            ++reaching;
+            if (find(indices.begin() + first, indices.begin() + first + listed, (uint32_t)i) == indices.begin() + first + listed)
+                ++missing;
+        }
+    }
+
+    const ClusteredLightStats& stats = clusters.getStats();
+    cout << "clustered lights (" << count << " lights, " << ClusteredLights::CLUSTERS << " clusters, " << resolveThreadCount(threads) << " threads)\n";
+    cout << "    build:          " << buildTime << " ms, " << stats.visibleLights << " lights in the depth range, " << stats.references
+         << " references, at most " << stats.maxPerCluster << " per cluster, " << stats.dropped << " dropped\n";
+    cout << "    per fragment:   " << (double)shaded / samples << " lights evaluated, " << (double)reaching / samples << " reach it\n";
+    cout << "    results match:  " << (missing == 0 ? "yes" : "NO") << " (" << missing << " reaching lights missing)\n";
+}
+
+// allocations of an upload ring region from several threads at once: aligned, inside the region, never overlapping
+void compareUploadRing(size_t allocations, unsigned threads)
+{
+    const size_t capacity = 64 << 20;
+    LinearAllocator space;
+    vector<pair<size_t, size_t>> ranges(allocations);
+    vector<size_t> alignments(allocations);
+    mt19937 random(1);
+    for (size_t i = 0; i < allocations; ++i) {
+        alignments[i] = (size_t)1 << (random() % 9);
+        ranges[i].second = 16 + random() % 1000;
+    }
+
+    double time = bestTime(5, [&]() {
+        space.reset(capacity);
+        parallelFor(allocations, threads, [&](size_t i) {
+            ranges[i].first = space.allocate(ranges[i].second, alignments[i]);
+        });
+    });
+
+    size_t failures = 0, misaligned = 0, overlaps = 0;
+    for (size_t i = 0; i < allocations; ++i) {
+        failures += ranges[i].first == LinearAllocator::NONE;
+        misaligned += ranges[i].first % alignments[i] != 0;
+    }
+    vector<pair<size_t, size_t>> sorted = ranges;
+    sort(sorted.begin(), sorted.end());
+    for (size_t i = 1; i < sorted.size(); ++i)
+        overlaps += sorted[i - 1].first + sorted[i - 1].second > sorted[i].first;
+    bool inside = sorted.empty() || sorted.back().first + sorted.back().second <= space.used();
+
+    cout << "upload ring (" << allocations << " allocations, " << resolveThreadCount(threads) << " threads)\n";
+    cout << "    allocate:       " << time << " ms, " << space.used() << " bytes used\n";
+    cout << "    results match:  " << (failures == 0 && misaligned == 0 && overlaps == 0 && inside ? "yes" : "NO") << " ("
+         << failures << " failed, " << misaligned << " misaligned, " << overlaps << " overlapping)\n";
+}
+
+// a producer publishing packets as fast as it can and a consumer sleeping until it gets them: the consumer has to see
+// whole packets, in order, and the last one. In lockstep the producer also sleeps until each packet is taken (as the
+// simulation loop does), so none is replaced
+void compareFramePackets(uint64_t frames, bool lockstep)
+{
+    FramePacketExchange packets;
+    uint64_t received = 0, torn = 0, outOfOrder = 0, last = 0;
+
+    auto start = chrono::steady_clock::now();
+    thread consumer([&]() {
+        while (FramePacket* packet = packets.waitAcquire()) {
+            ++received;
+            outOfOrder += received > 1 && packet->frame <= last;
+            last = packet->frame;
+            // every field was written from the frame number, a packet the producer still writes would mix two
+            bool whole = packet->draws.size() == packet->frame % 64 && packet->time == (GLfloat)packet->frame;
+            for (const FramePacketDraw& draw: packet->draws)
+                whole = whole && draw.lod == (GLuint)packet->frame;
+            torn += !whole;
+        }
+    });
+    for (uint64_t frame = 1; frame <= frames; ++frame) {
+        FramePacket& packet = packets.writable();
+        packet.clear();
+        packet.frame = frame;
+        packet.time = (GLfloat)frame;
+        for (uint64_t i = 0; i < frame % 64; ++i)
+            packet.draws.push_back(FramePacketDraw{nullptr, (GLuint)frame, glm::mat4(1.0f), glm::mat3(1.0f), nullptr});
+        packets.publish();
+        if (lockstep)
+            packets.waitTaken();
+    }
+    packets.close();
+    consumer.join();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "frame packets (" << frames << " published" << (lockstep ? ", in lockstep" : "") << ")\n";
+    cout << "    exchange:       " << elapsed.count() << " ms, " << received << " received" << (lockstep ? "" : ", the rest replaced by newer ones") << "\n";
+    cout << "    results match:  " << (torn == 0 && outOfOrder == 0 && last == frames && (!lockstep || received == frames) ? "yes" : "NO")
+         << " (" << torn << " torn, " << outOfOrder << " out of order, last " << last << ")\n";
+}
+
+// default load options without the mesh cache, so a benchmark run leaves no cache files under models/
+ObjLoadOptions uncachedOptions()
+{
+    ObjLoadOptions options;
+    options.meshCache = false;
+    return options;
+}
+
+// A scene of a floor, queued and instanced models and point lights, drawn through FrameRenderer on the null
+// graphics backend reporting GL major.minor. Each pass starts from a fresh shader and renderer, so passes over the
+// same scene have to ask the device for exactly the same things.
+struct HeadlessScene {
+    Model floor = Model("models/cube.obj", uncachedOptions());
+    vector<Model> models;
+    vector<PointLight> lights = vector<PointLight>(64);
+
+    HeadlessScene()
+    {
+        floor.addCollisionRectangle({
+            glm::vec3(-1.0f, -1.0f, 1.0f), glm::vec3(1.0f, -1.0f, 1.0f), glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-1.0f, -1.0f, -1.0f),
+            glm::vec3(-1.0f, 1.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f, 1.0f, -1.0f), glm::vec3(-1.0f, 1.0f, -1.0f)
+        });
+        floor.setTranslate(glm::vec3(0.0f, -2.0f, 0.0f));
+        floor.setScale(glm::vec3(20.0f, 1.0f, 20.0f));
+        for (GLuint i = 0; i < 400; ++i) {
+            models.push_back(Model(i % 2 == 0 ? "models/cube.obj" : "models/sphere.obj", uncachedOptions()));
+            models.back().setTranslate(glm::vec3((GLfloat)(i % 20) - 10.0f, 0.0f, -(GLfloat)(i / 20) * 2.0f));
+            models.back().setScale(glm::vec3(0.3f));
+        }
+        for (size_t i = 0; i < lights.size(); ++i)
+            lights[i] = PointLight{glm::vec3((GLfloat)(i % 8) * 2.0f - 8.0f, -0.5f, -(GLfloat)(i / 8) * 4.0f), 1.0f, 0.7f, 1.8f,
+                glm::vec3(0.02f), glm::vec3(1.0f), glm::vec3(1.0f)};
+    }
+
+    // draws frames, returns what the device was asked to do and sets the CPU time per frame
+    GraphicsStats pass(GLuint frames, double& milliseconds)
+    {
+        Shader shader("shaders/shader.vs", "shaders/shader.frag");
+        FrameRenderer renderer(shader, nullptr);
+        Camera camera(glm::vec3(0.0f, 1.0f, 5.0f));
+        FramePacket packet;
+        resetGraphicsStats();
+        auto start = chrono::steady_clock::now();
+        for (GLuint frame = 0; frame < frames; ++frame) {
+            packet.clear();
+            packet.frame = frame;
+            packet.width = 1280;
+            packet.height = 720;
+            packet.fovY = glm::radians(45.0f);
+            packet.aspect = 1280.0f / 720.0f;
+            packet.cameraPosition = camera.Position;
+            packet.uniforms.projection = glm::perspective(packet.fovY, packet.aspect, packet.nearPlane, packet.farPlane);
+            packet.uniforms.view = camera.GetViewMatrix();
+            packet.uniforms.viewPos = glm::vec4(camera.Position, 1.0f);
+            packet.lights = lights;
+            Model::setLodCamera(camera.Position, packet.fovY, 720.0f);
+            floor.DrawOccluder(packet);
+            floor.DrawInstanced(packet);
+            for (size_t i = 0; i < models.size(); ++i) {
+                if (i % 4 == 0)
+                    models[i].Submit(packet, shader);
+                else
+                    models[i].DrawInstanced(packet);
+            }
+            renderer.render(packet);
+        }
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        milliseconds = elapsed.count() / frames;
+        GraphicsStats stats = graphicsStats();
+        renderer.release();
+        return stats;
+    }
+};
+
+// the frame pipeline on the null backend, on the GL 3.3 paths and on the 4.6 ones (multi-draw indirect, persistent
+// upload ring); two passes each, the counts have to be the same
+void compareHeadless(GLuint frames)
+{
+    cout << "headless frames (null graphics backend, " << frames << " frames)\n";
+    bool same = true;
+    for (int major: {3, 4}) {
+        int minor = major == 3 ? 3 : 6;
+        loadGraphicsBackend(GRAPHICS_NULL, nullptr, major, minor);
+        double time = 0.0, again = 0.0;
+        GraphicsStats stats, repeat;
+        {
+            HeadlessScene scene;
+            stats = scene.pass(frames, time);
+            repeat = scene.pass(frames, again);
+        }
+        assetRegistry().collectGarbage();
+        same = same && memcmp(&stats, &repeat, sizeof(GraphicsStats)) == 0;
+        cout << "    GL " << major << "." << minor << ":         " << time << " ms per frame; per frame " << stats.drawCalls / frames
+             << " draw calls (" << stats.draws / frames << " draws, " << stats.triangles / frames << " triangles), "
+             << stats.programBinds / frames << " program / " << stats.vertexArrayBinds / frames << " VAO / "
+             << stats.bufferBinds / frames << " buffer / " << stats.textureBinds / frames << " texture binds, "
+             << stats.uniformUploads / frames << " uniforms, " << stats.bytesUploaded / frames << " bytes uploaded\n";
+    }
+    cout << "    results match:  " << (same ? "yes" : "NO") << " (the same counts in both passes)\n";
+}
+
+// threads recording nested CPU zones while another one collects them, GPU zones read back on the null backend,
+// and the export of it all; every zone has to arrive (or be counted as dropped) in the order it was recorded
+void compareProfiler(size_t zones, unsigned threads)
+{
+    threads = max(resolveThreadCount(threads), 2u);
+    Profiler& profiler = ::profiler();
+    profiler.clear();
+    profiler.setHistoryLimit(threads * zones * 2 + 1000);
+
+    vector<ProfileTrack*> tracks(threads);
+    atomic<unsigned> running(threads);
+    double producing = 0.0;
+    vector<thread> producers;
+    for (unsigned t = 0; t < threads; ++t)
+        producers.emplace_back([&, t]() {
+            tracks[t] = &profiler.threadTrack();
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < zones; ++i) {
+                ProfileZone outer("outer");
+                ProfileZone inner("inner");
+            }
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            if (t == 0)
+                producing = elapsed.count() / (zones * 2);
+            running.fetch_sub(1);
+        });
+    while (running.load() > 0) {
+        profiler.collect();
+        this_thread::yield();
+    }
+    for (thread& producer: producers)
+        producer.join();
+
+    loadGraphicsBackend(GRAPHICS_NULL, nullptr);
+    GLuint frames = 20;
+    GpuProfiler gpu("benchmark GPU");
+    for (GLuint frame = 0; frame < frames; ++frame) {
+        gpu.beginFrame();
+        GpuProfileZone outer(gpu, "gpu outer");
+        GpuProfileZone inner(gpu, "gpu inner");
+    }
+    gpu.release();
+    profiler.collect();
+
+    vector<ProfileEvent> events = profiler.getEvents();
+    size_t recorded = 0, dropped = 0, outOfOrder = 0, gpuEvents = 0, badGpu = 0;
+    map<uint32_t, uint64_t> lastEnd;
+    for (const ProfileEvent& event: events) {
+        if (profiler.getTrackName(event.track) == "benchmark GPU") {
+            ++gpuEvents;
+            badGpu += event.begin > event.end;
+            continue;
+        }
+        // zones are recorded when they end, so on one track the ends never go back
+        outOfOrder += event.begin > event.end || event.end < lastEnd[event.track];
+        lastEnd[event.track] = event.end;
+        ++recorded;
+    }
+    for (ProfileTrack* track: tracks)
+        dropped += track->ring.getDropped();
+    bool gpuMatch = gpu.getResolved() == gpuEvents && gpuEvents == 2 * (frames - GpuProfiler::FRAMES) && gpu.getSkipped() == 0 && badGpu == 0;
+
+    stringstream trace;
+    profiler.writeChromeTrace(trace);
+    string json = trace.str();
+    size_t written = 0;
+    for (size_t at = json.find("\"ph\":\"X\""); at != string::npos; at = json.find("\"ph\":\"X\"", at + 1))
+        ++written;
+    profiler.setHistoryLimit(1 << 18);
+    profiler.clear();
+
+    cout << "profiler (" << threads << " threads x " << zones << " nested zone pairs)\n";
+    cout << "    cpu zones:      " << producing << " ns per zone, " << recorded << " collected, " << dropped << " dropped by full rings\n";
+    cout << "    gpu zones:      " << gpu.getResolved() << " read back " << GpuProfiler::FRAMES << " frames late, " << gpu.getSkipped() << " skipped\n";
+    cout << "    chrome trace:   " << json.size() << " bytes, " << written << " zones\n";
+    cout << "    results match:  " << (recorded + dropped == threads * zones * 2 && outOfOrder == 0 && gpuMatch && written == events.size() ? "yes" : "NO")
+         << " (" << threads * zones * 2 - recorded - dropped << " lost, " << outOfOrder << " out of order, " << (gpuMatch ? 0 : 1) << " GPU mismatch)\n";
+}
+
+// the uniforms a few names resolve to, to compare a restored program with a compiled one
+string shaderSignature(Shader& shader)
+{
+    string signature;
+    for (const GLchar* name: {"model", "normalMatrix", "indirect", "lightGrid", "clusterCounts", "material.diffuse"})
+        signature += shader.uniform(UniformName(name)).valid() ? '1' : '0';
+    return signature + to_string(shader.uniformBlock("FrameData"));
+}
+
+// builds the permutations of the engine's shader on the null backend: cold (compiled, binaries saved), warm (every
+// program from the cache, no GLSL compiled), with a new permutation, with a binary the driver rejects, after a driver
+// update, and on GL 3.3 without program binaries
+void compareShaderLibrary()
+{
+    string directory = (filesystem::temp_directory_path() / "benchmark_shader_cache").string();
+    filesystem::remove_all(directory);
+    vector<ShaderDefines> permutations = {{}, {"NO_POINT_LIGHTS"}, {"MAX_LIGHTS 8", "NO_POINT_LIGHTS"}, {"NO_POINT_LIGHTS", "MAX_LIGHTS 8"}};
+
+    // compiles, cache hits, library stats and the signatures of the built shaders of one run
+    struct Run {
+        size_t compiles, binaries;
+        ShaderLibraryStats stats;
+        vector<string> signatures;
+        bool cache, kept;
+    };
+    auto run = [&](int major, int minor, const vector<ShaderDefines>& variants) {
+        loadGraphicsBackend(GRAPHICS_NULL, nullptr, major, minor);
+        resetGraphicsStats();
+        ShaderLibrary library("shaders/shader.vs", "shaders/shader.frag", nullptr, directory);
+        vector<size_t> indices;
+        for (const ShaderDefines& defines: variants)
+            indices.push_back(library.add(defines));
+        library.begin();
+        while (!library.ready());
+        // finish may run mid-frame, the program the frame had bound has to stay bound
+        const GLuint frameProgram = 1000;
+        glUseProgram(frameProgram);
+        library.finish();
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        Run result{graphicsStats().shaderCompiles, graphicsStats().programBinaries, library.getStats(), {}, library.hasBinaryCache(), current == (GLint)frameProgram};
+        for (size_t index: indices)
+            result.signatures.push_back(shaderSignature(library.get(index)));
+        library.release();
+        return result;
+    };
+
+    Run cold = run(4, 6, permutations);
+    Run warm = run(4, 6, permutations);
+    vector<ShaderDefines> more = permutations;
+    more.push_back({"NO_POINT_LIGHTS", "SHADOWS"});
+    Run added = run(4, 6, more);
+
+    // a binary of a format the driver does not know, as after an update that kept the version string
+    size_t files = 0;
+    for (const filesystem::directory_entry& entry: filesystem::directory_iterator(directory)) {
+        if (files++ > 0)
+            continue;
+        fstream file(entry.path(), ios::binary | ios::in | ios::out);
+        ProgramCacheHeader header;
+        file.read((char*)&header, sizeof(header));
+        header.format = 0;
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+    }
+    Run rejected = run(4, 6, more);
+    Run updated = run(4, 5, more);
+    Run old = run(3, 3, permutations);
+    filesystem::remove_all(directory);
+
+    // the defines go after #version, the line after them is line 2 of the file again
+    string source = shaderPermutationSource("#version 330 core\nvoid main() {}\n", {"A", "B 2"});
+    bool injected = source == "#version 330 core\n#define A\n#define B 2\n#line 2\nvoid main() {}\n";
+
+    // the same four programs, the last two permutations are one
+    bool match = cold.stats.compiled == 3 && cold.compiles == 6 && cold.stats.cacheWrites == 3 && cold.stats.failed == 0
+        && warm.stats.cacheHits == 3 && warm.compiles == 0 && warm.binaries == 3 && warm.signatures == cold.signatures
+        && added.stats.cacheHits == 3 && added.stats.compiled == 1
+        && rejected.stats.cacheHits == 3 && rejected.stats.compiled == 1 && rejected.stats.cacheWrites == 1
+        && updated.stats.cacheHits == 0 && updated.stats.compiled == 4
+        && !old.cache && old.stats.compiled == 3 && old.stats.cacheWrites == 0 && old.signatures == cold.signatures
+        && injected && cold.kept && warm.kept && old.kept;
+
+    cout << "shader permutations (" << permutations.size() << " asked for, null graphics backend)\n";
+    cout << "    cold start:     " << cold.stats.milliseconds << " ms, " << cold.stats.compiled << " programs compiled ("
+         << cold.compiles << " shaders), " << cold.stats.cacheWrites << " binaries saved\n";
+    cout << "    warm start:     " << warm.stats.milliseconds << " ms, " << warm.stats.cacheHits << " programs from the cache, "
+         << warm.compiles << " shaders compiled\n";
+    cout << "    invalidation:   new permutation " << added.stats.compiled << " compiled, rejected binary " << rejected.stats.compiled
+         << " recompiled, driver update " << updated.stats.compiled << " recompiled, GL 3.3 " << old.stats.compiled << " compiled\n";
+    cout << "    results match:  " << (match ? "yes" : "NO") << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    size_t faces = argc > 1 ? stoull(argv[1]) : 10000000;
+    unsigned threads = argc > 2 ? stoul(argv[2]) : 0;
+    string synthetic = "models/benchmark_synthetic.obj";
+
+    compare("models/sphere.obj", 20, threads);
+
+    writeSyntheticObj(synthetic, faces);
+    compare(synthetic, 1, threads);
+    remove(synthetic.c_str());
+
+    compareLodScale("models/sphere.obj");
+    compareSort(100000);
+    compareArena(100000);
+    compareCulling(100000);
+    compareFrameWorkers(2000, threads);
+    compareOcclusion(100000, threads);
+    compareClusters(4000, threads);
+    compareUploadRing(100000, threads);
+    compareFramePackets(200000, false);
+    compareFramePackets(20000, true);
+    compareHeadless(100);
+    compareProfiler(100000, threads);
+    compareShaderLibrary();
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Asset cooker: turns every OBJ (with its MTL libraries) under a directory into one asset archive
+// (see AssetArchive.h), which the game mounts with assetRegistry().mountArchive instead of parsing the files.
+// Each model is first cooked into its own mesh cache under <archive>.cook/, models whose cache is still
+// current are not parsed again; the models are cooked on several threads.
+// usage: cooker <source directory> <archive> [-j threads] [--optimize] [--compress] [--lods levels] [--weld epsilon]
+// Paths in the archive are the OBJ paths as found under the source directory, so run the cooker from the
+// directory the game runs in (e.g. cooker models models.pack).
+#include <glad/glad.h>
+
+#include "AssetArchive.h"
+#include "AssetRegistry.h"
+#include "MeshCache.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int usage()
+{
+    cout << "usage: cooker <source directory> <archive> [-j threads] [--optimize] [--compress] [--lods levels] [--weld epsilon]\n";
+    return 2;
+}
+
+// whether the archive already holds exactly these models, cooked with options
+bool archiveUpToDate(const string& archivePath, const vector<string>& models, const ObjLoadOptions& options)
+{
+    AssetArchive archive;
+    if (!archive.open(archivePath) || !archive.matches(options) || archive.entryCount() != models.size())
+        return false;
+    for (size_t i = 0; i < models.size(); ++i)
+        if (archive.entryPath(i) != models[i])
+            return false;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+    string sourceDirectory = argv[1];
+    string archivePath = argv[2];
+
+    ObjLoadOptions options;
+    unsigned threads = 0;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = stoul(argv[++i]);
+        else if (arg == "--optimize")
+            options.optimizeMeshes = true;
+        else if (arg == "--compress")
+            options.compressVertices = true;
+        else if (arg == "--lods" && i + 1 < argc)
+            options.lodLevels = stoul(argv[++i]);
+        else if (arg == "--weld" && i + 1 < argc)
+            options.weldEpsilon = stof(argv[++i]);
+        else
+            return usage();
+    }
+
+    error_code error;
+    vector<string> models;
+    for (filesystem::recursive_directory_iterator it(sourceDirectory, error), end; !error && it != end; it.increment(error))
+        if (it->is_regular_file() && it->path().extension() == ".obj")
+            models.push_back(it->path().generic_string());
+    if (error) {
+        cout << "ERROR::COOKER::DIRECTORY_NOT_SUCCESFULLY_READ: " << sourceDirectory << endl;
+        return 1;
+    }
+    // the archive is sorted by path anyway, sorting here keeps the cook order (and the log) stable
+    sort(models.begin(), models.end());
+
+    auto start = chrono::steady_clock::now();
+    string cookDirectory = archivePath + ".cook/";
+    atomic<size_t> cooked(0);
+    atomic<bool> failed(false);
+    mutex logLock;
+    parallelFor(models.size(), threads, [&](size_t i) {
+        const string& path = models[i];
+        string cachePath = meshCachePath(cookDirectory + path, options);
+        MeshCache cache;
+        if (cache.open(cachePath, path, options))
+            return;
+
+        ModelData data;
+        error_code error;
+        filesystem::create_directories(filesystem::path(cachePath).parent_path(), error);
+        bool ok = buildModelData(path, data, options) && writeMeshCache(cachePath, path, data, options);
+        lock_guard<mutex> lock(logLock);
+        if (ok) {
+            ++cooked;
+            cout << "cooked " << path << "\n";
+        }
+        else {
+            failed = true;
+            cout << "ERROR::COOKER::MODEL_NOT_SUCCESFULLY_COOKED: " << path << endl;
+        }
+    });
+    if (failed)
+        return 1;
+
+    if (cooked == 0 && archiveUpToDate(archivePath, models, options)) {
+        cout << archivePath << " is up to date (" << models.size() << " models)\n";
+        return 0;
+    }
+
+    // every cache is current now, link them into the archive
+    vector<unique_ptr<MeshCache>> caches;
+    vector<pair<string, const MeshCache*>> entries;
+    for (const string& path: models) {
+        caches.emplace_back(new MeshCache());
+        if (!caches.back()->open(meshCachePath(cookDirectory + path, options), path, options)) {
+            cout << "ERROR::COOKER::CACHE_NOT_SUCCESFULLY_READ: " << path << endl;
+            return 1;
+        }
+        entries.push_back(make_pair(path, caches.back().get()));
+    }
+    if (!writeAssetArchive(archivePath, entries, options)) {
+        cout << "ERROR::COOKER::ARCHIVE_NOT_SUCCESFULLY_WRITTEN: " << archivePath << endl;
+        return 1;
+    }
+
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    cout << "wrote " << archivePath << ": " << models.size() << " models, " << cooked << " cooked, "
+         << filesystem::file_size(archivePath, error) / 1024 << " KB in " << elapsed.count() << " ms\n";
+    return 0;
+}
@@ -4,9 +4,16 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "FramePacket.h"
+#include "FrameRenderer.h"
+#include "GraphicsDevice.h"
 #include "Player.h"
+#include "Profiler.h"
+#include "ShaderLibrary.h"
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -28,8 +35,14 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// framebuffer size, set by the resize callback and passed to the render thread in the frame packets
+atomic<int> framebufferWidth(SCR_WIDTH);
+atomic<int> framebufferHeight(SCR_HEIGHT);
+
 int main()
 {
+    PROFILE_THREAD("simulation");
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -51,6 +64,10 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    framebufferWidth.store(width);
+    framebufferHeight.store(height);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -60,7 +77,7 @@ int main()
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!loadGraphicsBackend(GRAPHICS_OPENGL, (GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
@@ -74,10 +91,23 @@ int main()
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("shaders/shader.vs", "shaders/shader.frag");
+    // restored from the program binary cache when it has them, otherwise compiled by the driver while the
+    // models load
+    ShaderLibrary shaders("shaders/shader.vs", "shaders/shader.frag", (GLADloadproc)glfwGetProcAddress);
+    size_t litShader = shaders.add({});
+    shaders.begin();
+    // small coloured lights circling over the floor, each fragment only shades the ones of its cluster
+    vector<PointLight> pointLights(64);
+    for (size_t i = 0; i < pointLights.size(); ++i) {
+        GLfloat hue = (GLfloat)i / pointLights.size() * 6.2831853f;
+        glm::vec3 colour = glm::vec3(0.5f) + 0.5f * glm::vec3(glm::cos(hue), glm::cos(hue + 2.094f), glm::cos(hue + 4.189f));
+        pointLights[i] = PointLight{glm::vec3(0.0f), 1.0f, 0.7f, 1.8f, colour * 0.02f, colour, colour};
+    }
 
     // load models
     // -----------
+    // the cooked archive (see src/cooker.cpp) replaces the loose model files when it is there
+    assetRegistry().mountArchive("models.pack");
     StaticModel floor("models/cube.obj");
     vector<glm::vec3> cubeVertex = {
         glm::vec3(-1.0f, -1.0f, 1.0f),
@@ -102,13 +132,43 @@ int main()
     player.addCollisionRectangle(cubeVertex);
     player.setTranslate(glm::vec3(0.0f, 10.0f, 0.0f));
 
+    shaders.finish();
+    Shader& ourShader = shaders.get(litShader);
+    // draws the frame packets, with the GL objects of every pass
+    FrameRenderer renderer(ourShader, (GLADloadproc)glfwGetProcAddress);
+
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // render thread
+    // -------------
+    // owns the GL context from here on and draws the packets the loop below publishes, so the simulation of
+    // the next frame runs while the driver works on the current one
+    FramePacketExchange packets;
+    glfwMakeContextCurrent(NULL);
+    thread renderThread([&]() {
+        PROFILE_THREAD("render");
+        glfwMakeContextCurrent(window);
+        // sleeps until the next packet, ends when the loop below closes the exchange
+        while (FramePacket* packet = packets.waitAcquire()) {
+            renderer.render(*packet);
+            // upload models loaded in the background, then free the GL objects of models that went away
+            assetRegistry().processUploads(2.0f);
+            assetRegistry().collectGarbage();
+
+            // glfw: swap buffers
+            // ------------------
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
+        glfwMakeContextCurrent(NULL);
+    });
+
+    // simulation loop
+    // ---------------
+    for (uint64_t frameNumber = 0; !glfwWindowShouldClose(window); ++frameNumber)
     {
+        PROFILE_ZONE("frame");
         // per-frame time logic
         // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
@@ -121,46 +181,64 @@ int main()
         glfwPollEvents();
         processInput(window);
 
-        // render
-        // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
-
-        ourShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        ourShader.setVec3("viewPos", player.getCameraPosition());
-
-        // light properties
-        ourShader.setVec3("dirLight.ambient", 0.07f, 0.07f, 0.07f);
-        ourShader.setVec3("dirLight.diffuse", 0.5f, 0.5f, 0.5f);
-        ourShader.setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(player.getCameraZoom()), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = player.getCameraViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // render the loaded model
-        floor.StaticDraw(ourShader);
-
         // fallingSphere.setBoostWithCollisionRectangleSphere(ourModel);
         // fallingSphere.setBoostWithCollisionRectangleSphere(ourModel2);
         fallingSphere.setBoostWithCollisionRectangle(floor);
-        fallingSphere.PhysicDraw(ourShader, deltaTime);
+        fallingSphere.PhysicUpdate(deltaTime);
 
         player.setBoostWithCollisionRectangle(floor);
         // player.setBoostWithCollisionRectangle(fallingSphere);
-        player.playerDraw(ourShader, deltaTime);
-
-
-        // glfw: swap buffers
-        // ------------------
-        glfwSwapBuffers(window);
+        player.playerUpdate(deltaTime);
+
+        // the frame packet: camera and light, the models and lights as they are now
+        FramePacket& packet = packets.writable();
+        packet.clear();
+        packet.frame = frameNumber;
+        packet.time = currentFrame;
+        packet.width = framebufferWidth.load();
+        packet.height = framebufferHeight.load();
+        packet.fovY = glm::radians(player.getCameraZoom());
+        packet.aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        packet.nearPlane = 0.1f;
+        packet.farPlane = 100.0f;
+        packet.cameraPosition = player.getCameraPosition();
+        FrameUniforms& frame = packet.uniforms;
+        frame.projection = glm::perspective(packet.fovY, packet.aspect, packet.nearPlane, packet.farPlane);
+        frame.view = player.getCameraViewMatrix();
+        frame.viewPos = glm::vec4(player.getCameraPosition(), 1.0f);
+        frame.lightDirection = glm::vec4(-0.2f, -1.0f, -0.3f, 0.0f);
+        frame.lightAmbient = glm::vec4(0.07f, 0.07f, 0.07f, 0.0f);
+        frame.lightDiffuse = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+        frame.lightSpecular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+        for (size_t i = 0; i < pointLights.size(); ++i) {
+            GLfloat angle = currentFrame * 0.3f + (GLfloat)i / pointLights.size() * 6.2831853f;
+            GLfloat distance = 2.0f + 6.0f * (GLfloat)(i % 4) / 4.0f;
+            pointLights[i].position = glm::vec3(distance * glm::cos(angle), -0.5f, distance * glm::sin(angle));
+        }
+        packet.lights = pointLights;
+
+        Model::setLodCamera(player.getCameraPosition(), packet.fovY, (float)SCR_HEIGHT);
+        floor.DrawOccluder(packet);
+        floor.DrawInstanced(packet);
+        fallingSphere.Submit(packet, ourShader);
+        player.Submit(packet, ourShader);
+        packets.publish();
+
+        // at most one packet ahead: frame N + 1 is simulated while the render thread draws frame N
+        {
+            PROFILE_ZONE("wait for render");
+            packets.waitTaken();
+        }
+        // the zones of every thread move into the profiler's history once per frame
+        profiler().collect();
         // break;
     }
+    packets.close();
+    renderThread.join();
+#if PROFILER_ENABLED
+    // open in chrome://tracing or ui.perfetto.dev
+    profiler().exportChromeTrace("profile.json");
+#endif
     // while (true)
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -202,7 +280,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // the render thread owns the context, it sets the viewport when the next packet has the new size
+    framebufferWidth.store(width);
+    framebufferHeight.store(height);
 }
 
 // glfw: whenever the mouse moves, this callback is called